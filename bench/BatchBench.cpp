@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+
+#include "Context.h"
+
+// A mix of lines which do and don't match so both the passthrough and the
+// rewriting paths are exercised
+auto batch_corpus(size_t lines) -> std::string {
+  auto result = std::string();
+  for (size_t i = 0; i < lines; i++) {
+    result += (i % 4 == 0)
+      ? "GET /index.html 200 " + std::to_string(i) + nl
+      : "POST /api/v1/items 404 " + std::to_string(i) + nl;
+  }
+  return result;
+}
+
+constexpr static auto batch_script = R"({
+  "y": { "arguments": ["GET", "get"] },
+  "s": { "arguments": ["404", "not found"] },
+  "t": { "arguments": ["done"] },
+  "a": { "arguments": ["--"] },
+  ":": { "arguments": ["done"] }
+})";
+
+auto run_batch_benchmark(benchmark::State& state, bool batch) -> void {
+  auto input = batch_corpus(state.range(0));
+  auto options = Options();
+  options.batch = batch;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(execute(input, batch_script, std::nullopt,
+          parse_json, options));
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_row_at_a_time(benchmark::State& state) {
+  run_batch_benchmark(state, false);
+}
+BENCHMARK(BM_row_at_a_time)->Arg(1 << 10)->Arg(1 << 12);
+
+static void BM_batched(benchmark::State& state) {
+  run_batch_benchmark(state, true);
+}
+BENCHMARK(BM_batched)->Arg(1 << 10)->Arg(1 << 12);
@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include "Corpus.h"
+
+// Every command is measured through execute over the same corpus, so subtract
+// BM_command/empty to get at the cost of the command itself
+constexpr static auto command_lines = size_t(1) << 12;
+
+auto command_corpus() -> const std::string& {
+  static const auto corpus = make_corpus(command_lines,
+      LineLengths::mixed, 10);
+  return corpus;
+}
+
+auto bench_file(const std::string& name) -> std::string {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+auto run_command_benchmark(benchmark::State& state, const std::string& script)
+  -> void {
+  const auto& input = command_corpus();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(execute(input, script));
+  }
+  set_throughput(state, input, command_lines);
+}
+
+BENCHMARK_CAPTURE(run_command_benchmark, empty,
+    std::string(R"({ ":": { "arguments": ["nothing"] } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, s,
+    std::string(R"({ "s": { "arguments": ["needle", "thread"] } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, s_regex,
+    std::string(R"({ "s": { "arguments": ["([a-e]+)x", "<$1>"] } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, y,
+    std::string(R"({ "y": { "arguments": ["abcdef", "ABCDEF"] } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, a,
+    std::string(R"({ "a": { "arguments": ["appended"] } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, N_D,
+    std::string(R"({ "N": { }, "D": { } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, H,
+    std::string(R"({ "H": { } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, h_G,
+    std::string(R"({ "h": { }, "G": { } })"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, b,
+    std::string(R"({
+  "b": { "arguments": ["end"] },
+  "p": { },
+  ":": { "arguments": ["end"] }
+})"));
+
+BENCHMARK_CAPTURE(run_command_benchmark, t,
+    std::string(R"({
+  "s": { "arguments": ["needle", "thread"] },
+  "t": { "arguments": ["end"] },
+  "p": { },
+  ":": { "arguments": ["end"] }
+})"));
+
+static void BM_command_w(benchmark::State& state) {
+  auto name = bench_file("sim_bench_w.txt");
+  run_command_benchmark(state, R"({ "w": { "arguments": [")" + name
+      + R"("] } })");
+  std::filesystem::remove(name);
+}
+BENCHMARK(BM_command_w);
+
+static void BM_command_r(benchmark::State& state) {
+  auto name = bench_file("sim_bench_r.txt");
+  std::ofstream(name) << make_corpus(16, LineLengths::short_lines, 0);
+  run_command_benchmark(state, R"({ "r": { "arguments": [")" + name
+      + R"("] } })");
+  std::filesystem::remove(name);
+}
+BENCHMARK(BM_command_r);
+
+static void BM_command_R(benchmark::State& state) {
+  // the file has as many lines as the input so every R reads one
+  auto name = bench_file("sim_bench_R.txt");
+  std::ofstream(name) << command_corpus();
+  run_command_benchmark(state, R"({ "R": { "arguments": [")" + name
+      + R"("] } })");
+  std::filesystem::remove(name);
+}
+BENCHMARK(BM_command_R);
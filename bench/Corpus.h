@@ -0,0 +1,57 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <random>
+#include <string>
+
+#include "Context.h"
+
+// How long the lines of a synthetic corpus are
+enum class LineLengths {
+  // 16 bytes, i.e. ids and short records
+  short_lines,
+  // 256 bytes, i.e. log lines
+  long_lines,
+  // mostly short with the occasional very long line, geometric around 64 bytes
+  mixed,
+};
+
+// The word planted in matching lines, scripts substitute or translate it
+constexpr static auto corpus_needle = "needle";
+
+// Deterministic so runs compare against each other, match_percent of the lines
+// contain corpus_needle
+inline auto make_corpus(size_t lines, LineLengths lengths,
+    size_t match_percent) -> std::string {
+  auto random = std::mt19937(size_t(0x51d));
+  auto geometric = std::geometric_distribution<size_t>(1.0 / 64);
+  auto percent = std::uniform_int_distribution<size_t>(0, 99);
+  auto letter = std::uniform_int_distribution<int>('a', 'z');
+  auto result = std::string();
+  for (size_t i = 0; i < lines; i++) {
+    auto length = lengths == LineLengths::short_lines ? size_t(16)
+      : lengths == LineLengths::long_lines ? size_t(256)
+      : std::max(geometric(random), size_t(1));
+    auto line = std::string();
+    line.reserve(length);
+    if (percent(random) < match_percent) {
+      line += corpus_needle;
+    }
+    while (line.size() < length) {
+      line += static_cast<char>(letter(random));
+    }
+    result += line + nl;
+  }
+  return result;
+}
+
+// Reported as bytes_per_second and lines/s
+inline auto set_throughput(benchmark::State& state, const std::string& input,
+    size_t lines) -> void {
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * lines);
+  state.counters["lines/s"] = benchmark::Counter(static_cast<double>(lines),
+      benchmark::Counter::kIsIterationInvariantRate);
+}
@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+
+#include "Corpus.h"
+#include "Engine.h"
+
+// A small but typical script, filter on the needle, rewrite it and tidy up
+constexpr static auto execute_script = R"({
+  "s": { "arguments": ["needle", "thread"] },
+  "t": { "arguments": ["keep"] },
+  "d": { },
+  ":": { "arguments": ["keep"] },
+  "y": { "arguments": ["aeiou", "AEIOU"] },
+  "a": { "arguments": ["--"] }
+})";
+
+// range(0) lines, range(1) a LineLengths, range(2) percent of lines matching
+static void BM_execute(benchmark::State& state) {
+  auto lines = static_cast<size_t>(state.range(0));
+  auto input = make_corpus(lines, static_cast<LineLengths>(state.range(1)),
+      static_cast<size_t>(state.range(2)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(execute(input, execute_script));
+  }
+  set_throughput(state, input, lines);
+}
+BENCHMARK(BM_execute)
+  ->ArgNames({"lines", "lengths", "match%"})
+  ->ArgsProduct({
+      {1 << 10, 1 << 13},
+      {static_cast<int64_t>(LineLengths::short_lines),
+       static_cast<int64_t>(LineLengths::long_lines),
+       static_cast<int64_t>(LineLengths::mixed)},
+      {0, 10, 100}});
+
+// The same script through the serial, batched and threaded executors
+static void BM_execute_options(benchmark::State& state) {
+  auto lines = size_t(1) << 13;
+  auto input = make_corpus(lines, LineLengths::mixed, 10);
+  auto options = Options();
+  options.batch = state.range(0) == 1;
+  options.threads = state.range(0) == 2 ? 0 : 1;
+  options.parallel_min_bytes = 1 << 12;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(execute(input, execute_script, std::nullopt,
+          parse_json, options));
+  }
+  set_throughput(state, input, lines);
+}
+BENCHMARK(BM_execute_options)->ArgName("serial|batch|threads")
+  ->DenseRange(0, 2);
+
+// One small payload at a time, the way a service embedding sim runs it:
+// execute parses and compiles the script every call, an Engine once
+static void BM_small_payloads(benchmark::State& state) {
+  auto payload = std::string("a payload with a needle in it\n");
+  auto engine = Engine::compile(execute_script).value();
+  for (auto _ : state) {
+    if (state.range(0) == 0) {
+      benchmark::DoNotOptimize(execute(payload, execute_script));
+    } else {
+      benchmark::DoNotOptimize(engine.run(payload));
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_small_payloads)->ArgName("execute|engine")->DenseRange(0, 1);
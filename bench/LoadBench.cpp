@@ -0,0 +1,81 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+
+#include "Context.h"
+#include "ScriptCache.h"
+
+// Stands in for every command of a generated script, load never runs them
+auto generated_function(Context context, const Command&) -> ResultContext {
+  return context;
+}
+
+// A generated script of commands commands, each under its own registered
+// name so parse_json and parse_json_stream build the same program, with the
+// argument and address shapes of s, y, a and p in turn
+// parse_json's ordered document finds a key by walking the ones before it, so
+// its time grows with the square of the distinct names. Real scripts only use
+// the builtins' names, the sizes here are kept to where it still finishes.
+auto make_script(size_t commands) -> std::string {
+  auto script = std::string("{\n");
+  for (size_t i = 0; i < commands; i++) {
+    auto n = std::to_string(i);
+    auto name = "generated_" + n;
+    register_command(name, generated_function);
+    script += "  \"" + name + "\": ";
+    switch (i % 4) {
+      case 0:
+        script += R"({ "arguments": ["needle)" + n + R"(", "thread"] })";
+        break;
+      case 1:
+        script += R"({ "arguments": ["abc", "xyz"] })";
+        break;
+      case 2:
+        script += R"({ "address": )" + n + R"(, "arguments": ["--"] })";
+        break;
+      default:
+        script += R"({ })";
+        break;
+    }
+    script += i + 1 < commands ? ",\n" : "\n";
+  }
+  return script + "}\n";
+}
+
+static void BM_parse(benchmark::State& state) {
+  auto script = make_script(static_cast<size_t>(state.range(1)));
+  auto parse = state.range(0) == 0 ? parse_json : parse_json_stream;
+  auto commands = size_t(0);
+  for (auto _ : state) {
+    auto parsed = parse(script);
+    commands = parsed->size();
+    benchmark::DoNotOptimize(parsed);
+  }
+  state.counters["commands"] = static_cast<double>(commands);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()
+        * script.size()));
+}
+BENCHMARK(BM_parse)->ArgNames({"dom|stream", "commands"})
+  ->ArgsProduct({{0, 1}, {1000, 20000}})->Unit(benchmark::kMillisecond);
+
+// Everything execute does before the first line, over an empty input: parse
+// (or load from the script cache), compile and open handles
+static void BM_startup(benchmark::State& state) {
+  auto script = make_script(static_cast<size_t>(state.range(1)));
+  auto options = Options();
+  auto text_to_commands = state.range(0) == 0 ? parse_json : parse_json_stream;
+  auto directory = (std::filesystem::temp_directory_path()
+      / "sim_bench_script_cache").string();
+  std::filesystem::remove_all(directory);
+  if (state.range(0) == 2) {
+    options.script_cache_dir = directory;
+    execute("", script, std::nullopt, text_to_commands, options);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(execute("", script, std::nullopt,
+          text_to_commands, options));
+  }
+  std::filesystem::remove_all(directory);
+}
+BENCHMARK(BM_startup)->ArgNames({"dom|stream|cached", "commands"})
+  ->ArgsProduct({{0, 1, 2}, {1000, 20000}})->Unit(benchmark::kMillisecond);
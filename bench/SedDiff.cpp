@@ -0,0 +1,155 @@
+// Runs pairs of equivalent sim and sed scripts over the same generated corpus,
+// checks the outputs are byte for byte the same and reports how sim's
+// throughput compares to the locally installed sed, per command family.
+//
+// usage: sim_sed_diff [--lines=N] [family sim.json script.sed]...
+// Without pairs the builtin ones below are run. sed is looked up in PATH
+// unless SIM_SED names one. Exits with 1 if any pair's outputs differ.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "Corpus.h"
+
+struct SedPair {
+  std::string family;
+  std::string sim_script;
+  std::string sed_script;
+};
+
+// sim's y replaces a string rather than mapping characters, so it pairs with
+// a global s. Everything else maps straight across.
+static const auto builtin_pairs = std::vector<SedPair>{
+  {"substitute", R"({ "s": { "arguments": ["needle", "thread"] } })",
+    "s/needle/thread/g"},
+  {"substitute_regex", R"({ "s": { "arguments": ["([a-e]+)x", "<$1>"] } })",
+    "s/([a-e]+)x/<\\1>/g"},
+  {"translate", R"({ "y": { "arguments": ["abc", "xyz"] } })",
+    "s/abc/xyz/g"},
+  {"append", R"({ "a": { "arguments": ["appended"] } })", "a appended"},
+  {"insert", R"({ "i": { "arguments": ["inserted"] } })", "i inserted"},
+  {"print", R"({ "p": { } })", "p"},
+  {"line_number", R"({ "=": { } })", "="},
+  {"hold", R"({ "h": { }, "G": { } })", "h\nG"},
+  {"next", R"({ "n": { }, "d": { } })", "n\nd"},
+  {"branch", R"({
+  "s": { "arguments": ["needle", "thread"] },
+  "t": { "arguments": ["keep"] },
+  "d": { },
+  ":": { "arguments": ["keep"] }
+})", "s/needle/thread/g\nt keep\nd\n:keep"},
+};
+
+constexpr static auto repetitions = 3;
+
+auto read_file(const std::string& name) -> std::string {
+  auto file = std::ifstream(name, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("sim_sed_diff: unable to open file with name: "
+        + name);
+  }
+  return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+auto write_file(const std::string& name, const std::string& contents) -> void {
+  std::ofstream(name, std::ios::binary) << contents;
+}
+
+// Best of repetitions, returns the output of the last run
+template<typename Run>
+auto best_seconds(Run run, std::string& output) -> double {
+  auto best = std::numeric_limits<double>::max();
+  for (int i = 0; i < repetitions; i++) {
+    auto start = std::chrono::steady_clock::now();
+    output = run();
+    best = std::min(best, std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+auto run_sed(const std::string& sed, const std::string& script_file,
+    const std::string& input_file) -> std::string {
+  auto command = sed + " -E -f '" + script_file + "' '" + input_file + "'";
+  std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"),
+      pclose);
+  if (!pipe) {
+    throw std::runtime_error("sim_sed_diff: unable to run: " + command);
+  }
+  auto output = std::string();
+  auto buffer = std::array<char, 1 << 16>();
+  while (auto count = std::fread(buffer.data(), 1, buffer.size(), pipe.get())) {
+    output.append(buffer.data(), count);
+  }
+  return output;
+}
+
+auto first_difference(const std::string& a, const std::string& b) -> size_t {
+  auto [i, _] = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+  return static_cast<size_t>(i - a.begin());
+}
+
+auto main(int argc, char* argv[]) -> int {
+  auto lines = size_t(1) << 16;
+  auto pairs = std::vector<SedPair>();
+  auto arguments = std::vector<std::string>(argv + 1, argv + argc);
+  for (size_t i = 0; i < arguments.size(); i++) {
+    if (arguments[i].starts_with("--lines=")) {
+      lines = std::stoull(arguments[i].substr(std::string("--lines=").size()));
+    } else if (i + 2 < arguments.size()) {
+      pairs.push_back({arguments[i], read_file(arguments[i + 1]),
+          read_file(arguments[i + 2])});
+      i += 2;
+    } else {
+      std::cerr << "usage: sim_sed_diff [--lines=N] "
+        "[family sim.json script.sed]..." << std::endl;
+      return 2;
+    }
+  }
+  if (pairs.empty()) {
+    pairs = builtin_pairs;
+  }
+  const auto* sed_variable = std::getenv("SIM_SED");
+  auto sed = std::string(sed_variable ? sed_variable : "sed");
+
+  auto directory = std::filesystem::temp_directory_path();
+  auto input_file = (directory / "sim_sed_diff_input.txt").string();
+  auto script_file = (directory / "sim_sed_diff_script.sed").string();
+  auto input = make_corpus(lines, LineLengths::mixed, 10);
+  write_file(input_file, input);
+
+  std::printf("%-20s %12s %12s %8s  %s\n", "family", "sim MB/s", "sed MB/s",
+      "sim/sed", "output");
+  auto megabytes = static_cast<double>(input.size()) / (1 << 20);
+  auto mismatches = 0;
+  for (const auto& pair : pairs) {
+    write_file(script_file, pair.sed_script + "\n");
+    auto sim_output = std::string();
+    auto sed_output = std::string();
+    auto sim_seconds = best_seconds([&]() {
+        return execute(input, pair.sim_script); }, sim_output);
+    auto sed_seconds = best_seconds([&]() {
+        return run_sed(sed, script_file, input_file); }, sed_output);
+
+    auto verdict = std::string("same");
+    if (sim_output != sed_output) {
+      mismatches++;
+      verdict = "DIFFERS at byte "
+        + std::to_string(first_difference(sim_output, sed_output));
+    }
+    std::printf("%-20s %12.2f %12.2f %8.2f  %s\n", pair.family.c_str(),
+        megabytes / sim_seconds, megabytes / sed_seconds,
+        sed_seconds / sim_seconds, verdict.c_str());
+  }
+
+  std::filesystem::remove(input_file);
+  std::filesystem::remove(script_file);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+# find_package(sim) for the installed libsim, see the README
+include(CMakeFindDependencyMacro)
+find_dependency(tl-expected)
+find_dependency(nlohmann_json)
+find_dependency(Threads)
+
+include("${CMAKE_CURRENT_LIST_DIR}/simTargets.cmake")
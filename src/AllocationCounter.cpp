@@ -0,0 +1,68 @@
+// Replaces the global operator new and delete to feed allocation_counts, only
+// linked into the sim binary so that the library and tests keep the standard
+// allocator. Sizes come from malloc_usable_size, so this is linux only.
+
+#include "MemoryStats.h"
+
+#if defined(__linux__)
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace {
+  [[maybe_unused]] const auto enabled = (enable_allocation_counting(), true);
+
+  auto counted_new(std::size_t size) -> void* {
+    auto* pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer) {
+      count_allocation(malloc_usable_size(pointer));
+    }
+    return pointer;
+  }
+
+  auto counted_delete(void* pointer) -> void {
+    if (pointer) {
+      count_deallocation(malloc_usable_size(pointer));
+      std::free(pointer);
+    }
+  }
+}
+
+auto operator new(std::size_t size) -> void* {
+  if (auto* pointer = counted_new(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+auto operator new[](std::size_t size) -> void* {
+  if (auto* pointer = counted_new(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+auto operator new(std::size_t size, const std::nothrow_t&) noexcept -> void* {
+  return counted_new(size);
+}
+
+auto operator new[](std::size_t size, const std::nothrow_t&) noexcept -> void* {
+  return counted_new(size);
+}
+
+auto operator delete(void* pointer) noexcept -> void {
+  counted_delete(pointer);
+}
+
+auto operator delete[](void* pointer) noexcept -> void {
+  counted_delete(pointer);
+}
+
+auto operator delete(void* pointer, std::size_t) noexcept -> void {
+  counted_delete(pointer);
+}
+
+auto operator delete[](void* pointer, std::size_t) noexcept -> void {
+  counted_delete(pointer);
+}
+#endif
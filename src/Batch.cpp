@@ -0,0 +1,242 @@
+#include "Batch.h"
+
+#include <iostream>
+#include <regex>
+
+#include "Parallel.h"
+#include "Version.h"
+
+auto is_batchable(const Commands& commands, const Program& program) -> bool {
+  if (!is_line_local(commands, program)) {
+    return false;
+  }
+  for (size_t i = 0; i < program.size(); i++) {
+    const auto& arguments = commands[i].arguments;
+    auto argument_count = arguments ? arguments->size() : 0;
+    switch (program[i].opcode) {
+      case Opcode::substitute:
+      case Opcode::translate:
+        if (argument_count != 2) {
+          return false;
+        }
+        break;
+      case Opcode::assert_version:
+        if (argument_count != 1 || (*arguments)[0] != sim_version) {
+          return false;
+        }
+        break;
+      case Opcode::append:
+      case Opcode::branch:
+      case Opcode::change:
+      case Opcode::insert:
+      case Opcode::branch_true:
+      case Opcode::branch_false:
+      case Opcode::verify_label:
+        if (argument_count != 1) {
+          return false;
+        }
+        break;
+      default:
+        // the rest warn about arguments on every line
+        if (arguments) {
+          return false;
+        }
+    }
+  }
+  return true;
+}
+
+// One line of a batch, it stays a view into the input until it is written to
+struct BatchLine {
+  std::string_view input;
+  std::optional<std::string> operations;
+  // output of print commands, which comes before the line itself
+  std::string printed;
+  size_t next_command;
+  bool deleted;
+  bool last_replace_success;
+
+  BatchLine(std::string_view input)
+    : input(input),
+      operations(std::nullopt),
+      printed(std::string()),
+      next_command(0),
+      deleted(false),
+      last_replace_success(false) {}
+
+  auto view() const -> std::string_view {
+    return operations ? std::string_view(*operations) : input;
+  }
+
+  auto owned() -> std::string& {
+    if (!operations) {
+      operations = std::string(input);
+    }
+    return *operations;
+  }
+};
+
+// Everything about a command which can be worked out once per run
+struct BatchCommand {
+  Opcode opcode;
+  std::string_view first;
+  std::string_view second;
+  // index of the command to continue from after a jump, nullopt when the
+  // label doesn't exist which ends the script whatever the condition
+  std::optional<size_t> jump;
+  std::optional<std::regex> pattern;
+};
+
+auto run_command_over_batch(const Context& context, BatchCommand& command,
+    size_t index, std::vector<BatchLine>& lines) -> size_t {
+  const auto end = context.commands->size();
+  size_t finished = 0;
+  for (auto& line : lines) {
+    if (line.next_command != index) {
+      continue;
+    }
+    line.next_command = index + 1;
+    switch (command.opcode) {
+      case Opcode::append:
+        line.owned().append(nl).append(command.first);
+        break;
+      case Opcode::insert:
+        line.operations = std::string(command.first) + nl + std::string(line.view());
+        break;
+      case Opcode::change:
+        line.operations = std::string(command.first);
+        break;
+      case Opcode::zap:
+        line.operations = std::string();
+        break;
+      case Opcode::delete_:
+        line.deleted = true;
+        line.next_command = end;
+        break;
+      case Opcode::print_operations:
+        line.printed.append(line.view()).append(nl);
+        break;
+      case Opcode::unamb_operations:
+        line.operations = std::string(line.view()) + "$" + nl
+          + std::string(line.view());
+        break;
+      case Opcode::prepend_file_name:
+        if (context.file_stream.first) {
+          line.operations = *context.file_stream.first + nl
+            + std::string(line.view());
+        } else {
+          std::cerr << "prepend_file_name_function: no registered input file, did "
+            "you forget to assign it in a test?" << std::endl;
+        }
+        break;
+      case Opcode::substitute: {
+        if (!command.pattern) {
+          command.pattern = std::regex(std::string(command.first));
+        }
+        auto view = line.view();
+        auto replaced = std::string();
+        std::regex_replace(std::back_inserter(replaced), view.begin(), view.end(),
+            *command.pattern, std::string(command.second));
+        line.last_replace_success = replaced != view;
+        if (line.last_replace_success) {
+          line.operations = std::move(replaced);
+        }
+        break;
+      }
+      case Opcode::translate:
+        // most lines won't contain the text at all, those stay untouched views
+        if (line.view().find(command.first) != std::string_view::npos) {
+          translate_operations(line.owned(), std::string(command.first),
+              std::string(command.second));
+        }
+        break;
+      case Opcode::branch:
+        line.next_command = command.jump.value_or(end);
+        break;
+      case Opcode::branch_true:
+        if (!command.jump || line.last_replace_success) {
+          line.next_command = command.jump.value_or(end);
+        }
+        break;
+      case Opcode::branch_false:
+        if (!command.jump || !line.last_replace_success) {
+          line.next_command = command.jump.value_or(end);
+        }
+        break;
+      default:
+        // labels and required_version were checked by is_batchable
+        break;
+    }
+    if (line.next_command >= end) {
+      finished++;
+    }
+  }
+  return finished;
+}
+
+auto run_batched(Context context) -> Context {
+  auto batch_commands = std::vector<BatchCommand>();
+  for (size_t i = 0; i < context.commands->size(); i++) {
+    const auto& command = (*context.commands)[i];
+    auto batch_command = BatchCommand{(*context.program)[i].opcode, {}, {},
+      std::nullopt, std::nullopt};
+    if (command.arguments && command.arguments->size() > 0) {
+      batch_command.first = (*command.arguments)[0];
+    }
+    if (command.arguments && command.arguments->size() > 1) {
+      batch_command.second = (*command.arguments)[1];
+    }
+    if (batch_command.opcode == Opcode::branch
+        || batch_command.opcode == Opcode::branch_true
+        || batch_command.opcode == Opcode::branch_false) {
+      auto label = find_label_index(context, std::string(batch_command.first));
+      if (label) {
+        batch_command.jump = *label + 1;
+      }
+    }
+    batch_commands.push_back(std::move(batch_command));
+  }
+
+  const auto input = std::string_view(context.file_stream.second);
+  const auto nl_size = std::string_view(nl).size();
+  auto lines = std::vector<BatchLine>();
+  lines.reserve(batch_size);
+  size_t start = context.file_position;
+  size_t pos = 0;
+  auto* progress = context.handles->progress;
+  while (start < input.size()) {
+    const auto batch_start = start;
+    lines.clear();
+    while (lines.size() < batch_size
+        && (pos = find_delimiter(input, nl, start)) != std::string_view::npos) {
+      lines.emplace_back(input.substr(start, pos - start));
+      start = pos + nl_size;
+    }
+    if (lines.empty()) {
+      break;
+    }
+    context.cycle += lines.size();
+
+    auto remaining = batch_commands.empty() ? size_t(0) : lines.size();
+    // a backwards jump sends lines to a command which has already run over the
+    // batch, so keep sweeping until every line has reached the end
+    while (remaining > 0) {
+      for (size_t i = 0; i < batch_commands.size() && remaining > 0; i++) {
+        remaining -= run_command_over_batch(context, batch_commands[i], i, lines);
+      }
+    }
+
+    for (const auto& line : lines) {
+      context.result += line.printed;
+      if (!line.deleted) {
+        context.result.append(line.view()).append(nl);
+      }
+    }
+    if (progress) {
+      progress->add(lines.size(), start - batch_start);
+    }
+  }
+
+  context.file_position = start;
+  return context;
+}
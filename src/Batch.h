@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Context.h"
+
+constexpr auto batch_size = size_t(1024);
+
+// The batch executor only handles line local scripts (see is_line_local)
+// whose commands all have well formed arguments, anything else should go
+// through run_script so errors and warnings come out the same way.
+auto is_batchable(const Commands& commands, const Program& program) -> bool;
+
+// Drop in for run_script for batchable scripts. Rather than running the whole
+// script over one line at a time it takes batch_size lines at a time as views
+// into the input and runs each command over every line of the batch which has
+// reached it before moving on to the next command. Lines are only copied out
+// of the input once a command writes to them.
+auto run_batched(Context context) -> Context;
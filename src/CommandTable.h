@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Every builtin command resolves to one of these at script load, the
+// semantic function for each lives in Context.cpp.
+enum class Opcode : uint8_t {
+  append,
+  branch,
+  change,
+  delete_,
+  delete_restart,
+  insert,
+  execute,
+  prepend_file_name,
+  add_to_static,
+  nl_add_to_static,
+  replace_operation,
+  nl_replace_operation,
+  unamb_operations,
+  next_operation_space,
+  append_next_operation_space,
+  print_operations,
+  nl_print_operations,
+  quit,
+  quit_silent,
+  read_in_file,
+  read_in_file_line,
+  substitute,
+  branch_true,
+  branch_false,
+  assert_version,
+  append_to_file,
+  nl_append_to_file,
+  exchange,
+  translate,
+  zap,
+  prepend_line_no,
+  verify_label,
+  // commands added at runtime through register_command
+  custom,
+};
+constexpr auto opcode_count = static_cast<size_t>(Opcode::custom) + 1;
+
+struct CommandName {
+  std::string_view name;
+  Opcode opcode;
+};
+
+static constexpr auto command_names = std::to_array<CommandName>({
+  {"a",                           Opcode::append},
+  {"append",                      Opcode::append},
+  {"b",                           Opcode::branch},
+  {"branch",                      Opcode::branch},
+  {"c",                           Opcode::change},
+  {"change",                      Opcode::change},
+  {"d",                           Opcode::delete_},
+  {"delete",                      Opcode::delete_},
+  {"D",                           Opcode::delete_restart},
+  {"delete_restart",              Opcode::delete_restart},
+  {"i",                           Opcode::insert},
+  {"insert",                      Opcode::insert},
+  {"e",                           Opcode::execute},
+  {"execute",                     Opcode::execute},
+  {"F",                           Opcode::prepend_file_name},
+  {"prepend_file_name",           Opcode::prepend_file_name},
+  {"h",                           Opcode::add_to_static},
+  {"add_to_static",               Opcode::add_to_static},
+  {"H",                           Opcode::nl_add_to_static},
+  {"nl_add_to_static",            Opcode::nl_add_to_static},
+  {"g",                           Opcode::replace_operation},
+  {"replace_operation",           Opcode::replace_operation},
+  {"G",                           Opcode::nl_replace_operation},
+  {"nl_replace_operation",        Opcode::nl_replace_operation},
+  {"l",                           Opcode::unamb_operations},
+  {"unamb_operations_stream",     Opcode::unamb_operations},
+  {"n",                           Opcode::next_operation_space},
+  {"next_operation_space",        Opcode::next_operation_space},
+  {"N",                           Opcode::append_next_operation_space},
+  {"append_next_operation_space", Opcode::append_next_operation_space},
+  {"p",                           Opcode::print_operations},
+  {"print",                       Opcode::print_operations},
+  {"P",                           Opcode::nl_print_operations},
+  {"nl_print",                    Opcode::nl_print_operations},
+  {"q",                           Opcode::quit},
+  {"quit",                        Opcode::quit},
+  {"Q",                           Opcode::quit_silent},
+  {"quit_silent",                 Opcode::quit_silent},
+  {"r",                           Opcode::read_in_file},
+  {"read_in_file",                Opcode::read_in_file},
+  {"R",                           Opcode::read_in_file_line},
+  {"read_in_file_line",           Opcode::read_in_file_line},
+  {"s",                           Opcode::substitute},
+  {"substitute",                  Opcode::substitute},
+  {"t",                           Opcode::branch_true},
+  {"branch_true",                 Opcode::branch_true},
+  {"T",                           Opcode::branch_false},
+  {"branch_false",                Opcode::branch_false},
+  {"v",                           Opcode::assert_version},
+  {"required_version",            Opcode::assert_version},
+  {"w",                           Opcode::append_to_file},
+  {"append_to_file",              Opcode::append_to_file},
+  {"W",                           Opcode::nl_append_to_file},
+  {"nl_append_to_file",           Opcode::nl_append_to_file},
+  {"x",                           Opcode::exchange},
+  {"exchange",                    Opcode::exchange},
+  {"y",                           Opcode::translate},
+  {"translate",                   Opcode::translate},
+  {"z",                           Opcode::zap},
+  {"zap",                         Opcode::zap},
+  {"=",                           Opcode::prepend_line_no},
+  {"prepend_line_no",             Opcode::prepend_line_no},
+  {":",                           Opcode::verify_label},
+  {"label",                       Opcode::verify_label},
+});
+
+// fnv-1a with the seed folded into the offset basis, then a murmur3 style
+// finalizer so that the low bits we index with are actually mixed.
+constexpr auto command_hash(std::string_view name, uint32_t seed) -> uint32_t {
+  uint32_t hash = 2166136261u ^ seed;
+  for (auto c : name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+constexpr auto command_table_size = size_t(1024);
+constexpr auto empty_slot = uint8_t(0xff);
+static_assert(command_names.size() < empty_slot,
+    "command_names has outgrown the uint8_t slots of the perfect hash");
+
+struct PerfectHash {
+  uint32_t seed;
+  std::array<uint8_t, command_table_size> slots;
+};
+
+// Searched for at compile time, if you add a name to command_names and this
+// stops compiling either the name is a duplicate or the table needs to grow.
+constexpr auto build_perfect_hash() -> PerfectHash {
+  for (uint32_t seed = 0; seed < (1u << 12); seed++) {
+    auto result = PerfectHash{seed, {}};
+    result.slots.fill(empty_slot);
+    auto collision = false;
+    for (size_t i = 0; i < command_names.size() && !collision; i++) {
+      auto& slot = result.slots[
+        command_hash(command_names[i].name, seed) % command_table_size];
+      if (slot != empty_slot) {
+        collision = true;
+      } else {
+        slot = static_cast<uint8_t>(i);
+      }
+    }
+    if (!collision) {
+      return result;
+    }
+  }
+  throw "build_perfect_hash: no collision free seed, grow command_table_size";
+}
+
+static constexpr auto command_perfect_hash = build_perfect_hash();
+
+constexpr auto lookup_opcode(std::string_view name) -> std::optional<Opcode> {
+  const auto index = command_perfect_hash.slots[
+    command_hash(name, command_perfect_hash.seed) % command_table_size];
+  if (index == empty_slot || command_names[index].name != name) {
+    return std::nullopt;
+  }
+  return command_names[index].opcode;
+}
+
+static_assert(lookup_opcode("s") == Opcode::substitute);
+static_assert(lookup_opcode("nl_append_to_file") == Opcode::nl_append_to_file);
+static_assert(!lookup_opcode("not_a_command"));
+
+// The long name of a builtin's opcode, every short name in command_names is
+// followed by its long one
+constexpr auto opcode_name(Opcode opcode) -> std::string_view {
+  if (opcode == Opcode::custom) {
+    return "custom";
+  }
+  auto name = std::string_view();
+  for (const auto& command : command_names) {
+    if (command.opcode == opcode) {
+      name = command.name;
+    }
+  }
+  return name;
+}
+
+static_assert(opcode_name(Opcode::substitute) == "substitute");
+static_assert(opcode_name(Opcode::unamb_operations)
+    == "unamb_operations_stream");
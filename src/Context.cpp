@@ -1,17 +1,22 @@
 #include "Context.h"
 
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <ranges>
 #include <regex>
 #include <sstream>
 
+#include "Batch.h"
+#include "Optimizer.h"
+#include "Parallel.h"
+#include "ScriptCache.h"
 #include "Version.h"
 
-// We want to be able to handle/give context to errors when running sim
-// scripts
-using ResultContext = tl::expected<Context, std::string>;
-
 auto append_function(Context context, const Command& command) -> ResultContext {
   if (!command.arguments) {
     return tl::make_unexpected("append_function: no arguments provided");
@@ -28,8 +33,8 @@ auto append_function(Context context, const Command& command) -> ResultContext {
 
 auto find_label_index(const Context& context,
     const std::string label) -> std::optional<uint64_t> {
-  for (uint64_t i = 0; i < context.commands.size(); i++) {
-    const auto& command = context.commands[i];
+  for (uint64_t i = 0; i < context.commands->size(); i++) {
+    const auto& command = (*context.commands)[i];
     if (command.arguments
         && command.arguments->size() == 1
         && (command.name == ":" || command.name == "label")
@@ -50,7 +55,7 @@ auto branch_function(Context context, const Command& command) -> ResultContext {
   if (command.address && context.cycle == *command.address || !command.address) {
     auto maybe_label = find_label_index(context, (*command.arguments)[0]);
     if (!maybe_label) {
-      context.current_command = context.commands.size();
+      context.current_command = context.commands->size();
     } else {
       context.current_command = *maybe_label;
     }
@@ -79,7 +84,7 @@ auto delete_function(Context context, const Command& command) -> ResultContext {
   }
   if (command.address && context.cycle == *command.address || !command.address) {
     context.operations_stream = std::nullopt;
-    context.current_command = context.commands.size();
+    context.current_command = context.commands->size();
   }
   return context;
 }
@@ -92,7 +97,7 @@ auto delete_restart_function(Context context, const Command& command) -> ResultC
   size_t pos = 0;
   if (command.address && context.cycle == *command.address || !command.address) {
     if ((pos = context.operations_stream->find(nl)) != std::string::npos) {
-      context.operations_stream = context.operations_stream->erase(0, pos + 1);
+      context.operations_stream->erase(0, pos + 1);
       context.current_command = 0;
     } else {
       context.operations_stream = std::nullopt;
@@ -115,6 +120,21 @@ auto insert_function(Context context, const Command& command) -> ResultContext {
   return context;
 }
 
+// popen's fallback when there is no coprocess, read in large blocks
+auto popen_command(const std::string& command)
+  -> tl::expected<std::string, std::string> {
+  std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
+  if (!pipe) {
+    return tl::make_unexpected("popen() failed");
+  }
+  auto result = std::string();
+  auto buffer = std::array<char, 1 << 16>();
+  while (auto count = std::fread(buffer.data(), 1, buffer.size(), pipe.get())) {
+    result.append(buffer.data(), count);
+  }
+  return result;
+}
+
 auto execute_function(Context context, const Command& command) -> ResultContext {
 #ifndef __linux__
   return tl::make_unexpected("execute_function: command line execution only "
@@ -125,30 +145,22 @@ auto execute_function(Context context, const Command& command) -> ResultContext
       "ignoring them" << std::endl;
   }
 
-  std::array<char, 128> buffer;
-  std::string result;
-  auto full_command = *context.operations_stream;
-
-  if (command.address && context.cycle == *command.address) {
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(full_command.c_str(), "r"), pclose);
-    if (!pipe) {
-      return tl::make_unexpected("execute_function: popen() failed");
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe.get())) {
-      result += buffer.data();
-    }
-    context.operations_stream = result;
-  } else if (!command.address) {
-    std::cerr << "execute_function: warning: whole input file is being "
-      "executed, just write a shell script?" << std::endl;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(full_command.c_str(), "r"), pclose);
-    if (!pipe) {
-      return tl::make_unexpected("execute_function: popen() failed");
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe.get())) {
-      result += buffer.data();
+  static auto warned = std::once_flag();
+  if (!command.address) {
+    std::call_once(warned, []() {
+      std::cerr << "execute_function: warning: whole input file is being "
+        "executed, just write a shell script?" << std::endl;
+    });
+  }
+  if (command.address && context.cycle == *command.address || !command.address) {
+    auto result = context.handles->shell
+      ? context.handles->shell->run(*context.operations_stream)
+      : popen_command(*context.operations_stream);
+    if (!result) {
+      return tl::make_unexpected(std::string("execute_function: ")
+          + result.error());
     }
-    context.operations_stream = result;
+    context.operations_stream = std::move(result.value());
   }
   return context;
 #endif
@@ -191,9 +203,10 @@ auto nl_add_to_static_function(Context context, const Command& command) -> Resul
   }
 
   if (command.address && context.cycle == *command.address || !command.address) {
-    context.static_stream = context.static_stream
-      ? *context.static_stream + std::string(nl) + *context.operations_stream
-      : std::string(nl) + *context.operations_stream;
+    if (!context.static_stream) {
+      context.static_stream = std::string();
+    }
+    context.static_stream->append(nl).append(*context.operations_stream);
   }
   return context;
 }
@@ -250,15 +263,16 @@ auto next_operation_space_function(Context context, const Command& command) -> R
   }
   size_t pos = 0;
   if (command.address && context.cycle == *command.address || !command.address) {
-    if ((pos = context.file_stream.second.find(nl)) != std::string::npos) {
-      context.result += (*context.operations_stream + std::string(nl));
-      (*context.operations_stream)
-        = std::string(context.file_stream.second.substr(0, pos));
-      context.file_stream.second = context.file_stream.second.substr(pos + 1);
+    if ((pos = find_delimiter(context.file_stream.second, nl,
+            context.file_position)) != std::string::npos) {
+      context.result.append(*context.operations_stream).append(nl);
+      context.operations_stream->assign(context.file_stream.second,
+          context.file_position, pos - context.file_position);
+      context.file_position = pos + 1;
       // tricky, not mentioned in gnu sed manual
       context.cycle++;
     } else {
-      context.current_command = context.commands.size();
+      context.current_command = context.commands->size();
     }
   }
 
@@ -274,14 +288,15 @@ auto append_next_operation_space_function(Context context,
   }
   size_t pos = 0;
   if (command.address && context.cycle == *command.address || !command.address) {
-    if ((pos = context.file_stream.second.find(nl)) != std::string::npos) {
-      (*context.operations_stream)
-        += (std::string(nl) + std::string(context.file_stream.second.substr(0, pos)));
-      context.file_stream.second = context.file_stream.second.substr(pos + 1);
+    if ((pos = find_delimiter(context.file_stream.second, nl,
+            context.file_position)) != std::string::npos) {
+      context.operations_stream->append(nl).append(context.file_stream.second,
+          context.file_position, pos - context.file_position);
+      context.file_position = pos + 1;
       // tricky, not mentioned in gnu sed manual
       context.cycle++;
     } else {
-      context.current_command = context.commands.size();
+      context.current_command = context.commands->size();
     }
   }
 
@@ -309,9 +324,11 @@ auto nl_print_operations_function(Context context, const Command& command) -> Re
 
   if (command.address && context.cycle == *command.address || !command.address) {
     size_t pos;
-    if ((pos = context.file_stream.second.find(nl)) != std::string::npos) {
+    if ((pos = find_delimiter(context.file_stream.second, nl,
+            context.file_position)) != std::string::npos) {
       context.operations_stream = *context.operations_stream
-        + std::string(nl) + context.operations_stream->substr(0, pos);
+        + std::string(nl) + context.operations_stream->substr(0,
+            pos - context.file_position);
     } else {
       context.operations_stream = *context.operations_stream
         + std::string(nl) + *context.operations_stream;
@@ -320,15 +337,51 @@ auto nl_print_operations_function(Context context, const Command& command) -> Re
   return context;
 }
 
-auto quit_function(Context context, const Command& command) -> ResultContext {
-  if (!command.arguments) {
-    std::cerr << "quit_function: no arguments provided, exiting with code 1"
-      << std::endl;
-  } else if (command.arguments->size() != 1) {
-    std::cerr << "quit_function: quit expects 1 argument, exiting with code 1"
-      << std::endl;
+// Ends the cycle and the run, the exit code is the optional argument. With
+// print the pattern space is output as at the end of any other cycle.
+auto quit(Context context, const Command& command, bool print,
+    const std::string& name) -> ResultContext {
+  if (command.arguments && command.arguments->size() != 1) {
+    return tl::make_unexpected(name + ": quit expects at most 1 argument");
+  }
+  if (command.address && context.cycle != *command.address) {
+    return context;
   }
-  std::exit(std::stoi((*command.arguments)[0]));
+  auto exit_code = 0;
+  if (command.arguments) {
+    const auto& argument = (*command.arguments)[0];
+    auto [end, error] = std::from_chars(argument.data(),
+        argument.data() + argument.size(), exit_code);
+    if (error != std::errc() || end != argument.data() + argument.size()) {
+      return tl::make_unexpected(name + ": exit code is not a number: "
+          + argument);
+    } else if (exit_code < 0 || exit_code > 255) {
+      return tl::make_unexpected(name + ": exit code is not in 0-255: "
+          + argument);
+    }
+  }
+  context.handles->exit_code = exit_code;
+  if (!print) {
+    context.operations_stream = std::nullopt;
+  }
+  context.current_command = context.commands->size();
+  return context;
+}
+
+auto quit_function(Context context, const Command& command) -> ResultContext {
+  return quit(std::move(context), command, true, "quit_function");
+}
+
+auto quit_silent_function(Context context, const Command& command) -> ResultContext {
+  return quit(std::move(context), command, false, "quit_silent_function");
+}
+
+// The slot compile_commands gave the running command, nullopt if it wasn't
+// compiled (i.e. a hacker calling the function directly)
+auto current_slot(const Context& context) -> std::optional<size_t> {
+  return context.current_command < context.program->size()
+    ? (*context.program)[context.current_command].slot
+    : std::nullopt;
 }
 
 auto read_in_file_function(Context context, const Command& command) -> ResultContext {
@@ -339,33 +392,21 @@ auto read_in_file_function(Context context, const Command& command) -> ResultCon
   }
 
   if (command.address && context.cycle == *command.address || !command.address) {
-    if (context.stream_map.contains((*command.arguments)[0])) {
-      if (!context.stream_map[(*command.arguments)[0]].is_open()) {
-        return tl::make_unexpected("read_in_file_function: file exists in "
-            "stream_map but is not open");
+    auto slot = current_slot(context);
+    if (!slot) {
+      auto opened = context.handles->read_files.open((*command.arguments)[0]);
+      if (!opened) {
+        return tl::make_unexpected(std::string("read_in_file_function: ")
+            + opened.error());
       }
-
-      // reset it in case the file has already been read
-      context.stream_map[(*command.arguments)[0]].clear();
-      context.stream_map[(*command.arguments)[0]].seekg(0);
-    } else {
-      context.stream_map[(*command.arguments)[0]]
-        = std::fstream((*command.arguments)[0]);
+      slot = *opened;
     }
-
-    std::ostringstream buffer;
-    buffer << context.stream_map[(*command.arguments)[0]].rdbuf();
-
-    // if we don't do this there will be an extraneous nl for the majority of
-    // files processed :(
-    auto buffer_str = buffer.str();
-    const auto nl_str = std::string(nl);
-    if (buffer_str.size() >= nl_str.size()
-        && buffer_str.compare(buffer_str.size() - nl_str.size(), nl_str.size(), nl_str) == 0) {
-      buffer_str.erase(buffer_str.size() - nl_str.size());
+    auto contents = context.handles->read_files.get(*slot);
+    if (!contents) {
+      return tl::make_unexpected(std::string("read_in_file_function: ")
+          + contents.error());
     }
-
-    (*context.operations_stream) += (std::string(nl) + buffer_str);
+    context.operations_stream->append(nl).append(*contents);
   }
 
   return context;
@@ -380,17 +421,22 @@ auto read_in_file_line_function(Context context, const Command& command) -> Resu
   }
 
   if (command.address && context.cycle == *command.address || !command.address) {
-    if (!context.stream_map.contains((*command.arguments)[0])) {
-      context.stream_map[(*command.arguments)[0]] = std::fstream((*command.arguments)[0]);
+    auto slot = current_slot(context);
+    if (!slot) {
+      auto opened = context.handles->line_reader((*command.arguments)[0]);
+      if (!opened) {
+        return tl::make_unexpected(std::string("read_in_file_line_function: ")
+            + opened.error());
+      }
+      slot = *opened;
     }
-    if (!context.stream_map[(*command.arguments)[0]].is_open()) {
-      return tl::make_unexpected("read_in_file_function: file exists in "
-          "stream_map but is not open");
+    auto line = context.handles->line_readers[*slot].next_line();
+    if (!line) {
+      return tl::make_unexpected(std::string("read_in_file_line_function: ")
+          + line.error());
     }
-
-    std::string line;
-    if (std::getline(context.stream_map[(*command.arguments)[0]], line)) {
-      (*context.operations_stream) += (std::string(nl) + line);
+    if (*line) {
+      context.operations_stream->append(nl).append(**line);
     }
   }
   return context;
@@ -427,7 +473,7 @@ auto branch_true_function(Context context, const Command& command) -> ResultCont
   if (command.address && context.cycle == *command.address || !command.address) {
     auto maybe_label = find_label_index(context, (*command.arguments)[0]);
     if (!maybe_label) {
-      context.current_command = context.commands.size();
+      context.current_command = context.commands->size();
     } else if (context.last_replace_success) {
       context.current_command = *maybe_label;
     }
@@ -446,7 +492,7 @@ auto branch_false_function(Context context, const Command& command) -> ResultCon
   if (command.address && context.cycle == *command.address || !command.address) {
     auto maybe_label = find_label_index(context, (*command.arguments)[0]);
     if (!maybe_label) {
-      context.current_command = context.commands.size();
+      context.current_command = context.commands->size();
     } else if (!context.last_replace_success) {
       context.current_command = *maybe_label;
     }
@@ -482,13 +528,15 @@ auto append_to_file_function(Context context, const Command& command) -> ResultC
   }
 
   if (command.address && context.cycle == *command.address || !command.address) {
-    std::ofstream file_to_append;
-    file_to_append.open((*command.arguments)[0], std::ios::app);
-    if (!file_to_append) {
-      return tl::make_unexpected(std::string("append_to_file_function: unable to "
-            "open file with name: ") + (*command.arguments)[0]);
+    auto slot = current_slot(context);
+    auto line = *context.operations_stream + nl;
+    auto written = slot
+      ? context.handles->output_files.write(*slot, line)
+      : context.handles->output_files.write((*command.arguments)[0], line);
+    if (!written) {
+      return tl::make_unexpected(std::string("append_to_file_function: ")
+          + written.error());
     }
-    file_to_append << (*context.operations_stream) << nl;
   }
   return context;
 }
@@ -502,17 +550,15 @@ auto nl_append_to_file_function(Context context, const Command& command) -> Resu
   }
 
   if (command.address && context.cycle == *command.address || !command.address) {
-    std::ofstream file_to_append;
-    file_to_append.open((*command.arguments)[0], std::ios::app);
-    if (!file_to_append) {
-      return tl::make_unexpected(std::string("nl_append_to_file_function: unable to "
-            "open file with name: ") + (*command.arguments)[0]);
-    }
-    size_t pos = (*context.operations_stream).find((*command.arguments)[0]);
-    if (pos != std::string::npos) {
-      file_to_append << (*context.operations_stream).substr(0, pos + 1);
-    } else {
-      file_to_append << (*context.operations_stream) << nl;
+    const auto operations = std::string_view(*context.operations_stream);
+    auto slot = current_slot(context);
+    auto line = std::string(operations.substr(0, operations.find(nl))) + nl;
+    auto written = slot
+      ? context.handles->output_files.write(*slot, line)
+      : context.handles->output_files.write((*command.arguments)[0], line);
+    if (!written) {
+      return tl::make_unexpected(std::string("nl_append_to_file_function: ")
+          + written.error());
     }
   }
   return context;
@@ -532,6 +578,20 @@ auto exchange_function(Context context, const Command& command) -> ResultContext
   return context;
 }
 
+auto translate_operations(std::string& operations, const std::string& from,
+    const std::string& to) -> void {
+  if (from.empty()) {
+    return;
+  }
+  // scanning on from the end of the last replacement rather than the start
+  // keeps this linear, and stops a to containing from from looping forever
+  size_t pos = 0;
+  while ((pos = operations.find(from, pos)) != std::string::npos) {
+    operations.replace(pos, from.length(), to);
+    pos += to.length();
+  }
+}
+
 auto translate_function(Context context, const Command& command) -> ResultContext {
   if (!command.arguments) {
     return tl::make_unexpected("translate_function: no arguments provided");
@@ -539,14 +599,8 @@ auto translate_function(Context context, const Command& command) -> ResultContex
     return tl::make_unexpected("translate_function: translate expects 2 arguments");
   }
 
-  size_t pos = 0;
-  while ((pos = (*context.operations_stream)
-        .find((*command.arguments)[0])) != std::string::npos) {
-    (*context.operations_stream)
-      .replace(pos, (*command.arguments)[0].length(), (*command.arguments)[1]);
-    pos += (*command.arguments)[1].length();
-  }
-
+  translate_operations(*context.operations_stream, (*command.arguments)[0],
+      (*command.arguments)[1]);
   return context;
 }
 
@@ -587,127 +641,631 @@ auto verify_label_function(Context context, const Command& command) -> ResultCon
   return context;
 }
 
-using SemanticFunc = std::function<ResultContext(Context, const Command&)>;
-using CommandSemanticUMap = std::unordered_map<std::string, SemanticFunc>;
-static inline auto control_flow_map = CommandSemanticUMap {
-  {"a",                           append_function},
-  {"append",                      append_function},
-  {"b",                           branch_function},
-  {"branch",                      branch_function},
-  {"c",                           change_function},
-  {"change",                      change_function},
-  {"d",                           delete_function},
-  {"delete",                      delete_function},
-  {"D",                           delete_restart_function},
-  {"delete_restart",              delete_restart_function},
-  {"i",                           insert_function},
-  {"insert",                      insert_function},
-  {"e",                           execute_function},
-  {"execute",                     execute_function},
-  {"F",                           prepend_file_name_function},
-  {"prepend_file_name",           prepend_file_name_function},
-  {"h",                           add_to_static_function},
-  {"add_to_static",               add_to_static_function},
-  {"H",                           nl_add_to_static_function},
-  {"nl_add_to_static",            nl_add_to_static_function},
-  {"g",                           replace_operation_function},
-  {"replace_operation",           replace_operation_function},
-  {"G",                           nl_replace_operation_function},
-  {"nl_replace_operation",        nl_replace_operation_function},
-  {"l",                           unamb_operations_function},
-  {"unamb_operations_stream",     unamb_operations_function},
-  {"n",                           next_operation_space_function},
-  {"next_operation_space",        next_operation_space_function},
-  {"N",                           append_next_operation_space_function},
-  {"append_next_operation_space", append_next_operation_space_function},
-  {"p",                           print_operations_function},
-  {"print",                       print_operations_function},
-  {"P",                           nl_print_operations_function},
-  {"nl_print",                    nl_print_operations_function},
-  {"q",                           quit_function},
-  {"Q",                           quit_function},
-  {"quit",                        quit_function},
-  {"r",                           read_in_file_function},
-  {"read_in_file",                read_in_file_function},
-  {"R",                           read_in_file_line_function},
-  {"read_in_file_line",           read_in_file_line_function},
-  {"s",                           substitute_function},
-  {"substitute",                  substitute_function},
-  {"t",                           branch_true_function},
-  {"branch_true",                 branch_true_function},
-  {"T",                           branch_false_function},
-  {"branch_false",                branch_false_function},
-  {"v",                           assert_version_function},
-  {"required_version",            assert_version_function},
-  {"w",                           append_to_file_function},
-  {"append_to_file",              append_to_file_function},
-  {"W",                           nl_append_to_file_function},
-  {"nl_append_to_file",           nl_append_to_file_function},
-  {"x",                           exchange_function},
-  {"exchange",                    exchange_function},
-  {"y",                           translate_function},
-  {"translate",                   translate_function},
-  {"z",                           zap_function},
-  {"zap",                         zap_function},
-  {"=",                           prepend_line_no_function},
-  {"prepend_line_no",             prepend_line_no_function},
-  {":",                           verify_label_function},
-  {"label",                       verify_label_function},
-};
+using SemanticTable = std::array<SemanticFunc, opcode_count>;
+constexpr auto build_semantic_table() -> SemanticTable {
+  auto table = SemanticTable();
+  auto set = [&table](Opcode opcode, SemanticFunc function) {
+    table[static_cast<size_t>(opcode)] = function;
+  };
+  set(Opcode::append,                      append_function);
+  set(Opcode::branch,                      branch_function);
+  set(Opcode::change,                      change_function);
+  set(Opcode::delete_,                     delete_function);
+  set(Opcode::delete_restart,              delete_restart_function);
+  set(Opcode::insert,                      insert_function);
+  set(Opcode::execute,                     execute_function);
+  set(Opcode::prepend_file_name,           prepend_file_name_function);
+  set(Opcode::add_to_static,               add_to_static_function);
+  set(Opcode::nl_add_to_static,            nl_add_to_static_function);
+  set(Opcode::replace_operation,           replace_operation_function);
+  set(Opcode::nl_replace_operation,        nl_replace_operation_function);
+  set(Opcode::unamb_operations,            unamb_operations_function);
+  set(Opcode::next_operation_space,        next_operation_space_function);
+  set(Opcode::append_next_operation_space, append_next_operation_space_function);
+  set(Opcode::print_operations,            print_operations_function);
+  set(Opcode::nl_print_operations,         nl_print_operations_function);
+  set(Opcode::quit,                        quit_function);
+  set(Opcode::quit_silent,                 quit_silent_function);
+  set(Opcode::read_in_file,                read_in_file_function);
+  set(Opcode::read_in_file_line,           read_in_file_line_function);
+  set(Opcode::substitute,                  substitute_function);
+  set(Opcode::branch_true,                 branch_true_function);
+  set(Opcode::branch_false,                branch_false_function);
+  set(Opcode::assert_version,              assert_version_function);
+  set(Opcode::append_to_file,              append_to_file_function);
+  set(Opcode::nl_append_to_file,           nl_append_to_file_function);
+  set(Opcode::exchange,                    exchange_function);
+  set(Opcode::translate,                   translate_function);
+  set(Opcode::zap,                         zap_function);
+  set(Opcode::prepend_line_no,             prepend_line_no_function);
+  set(Opcode::verify_label,                verify_label_function);
+  return table;
+}
+static constexpr auto semantic_table = build_semantic_table();
 
-auto execute_from_files(const std::string& input_file,
-    const std::string& command_file) -> std::string {
-  auto maybe_input = file_to_string(input_file);
-  if (!maybe_input) {
-    throw std::runtime_error(maybe_input.error());
+// Only consulted while compiling a script, never per line.
+auto custom_commands() -> std::unordered_map<std::string, SemanticFunc>& {
+  static auto commands = std::unordered_map<std::string, SemanticFunc>();
+  return commands;
+}
+
+auto register_command(const std::string& name, SemanticFunc function) -> bool {
+  if (lookup_opcode(name) || !function) {
+    return false;
   }
-  auto input_text = maybe_input.value();
+  return custom_commands().emplace(name, function).second;
+}
 
-  auto maybe_json = file_to_string(command_file);
-  if (!maybe_json) {
-    throw std::runtime_error(maybe_json.error());
+auto semantic_function(Opcode opcode, const std::string& name)
+  -> std::optional<SemanticFunc> {
+  if (opcode != Opcode::custom) {
+    return semantic_table[static_cast<size_t>(opcode)];
+  }
+  if (auto custom = custom_commands().find(name);
+      custom != custom_commands().end()) {
+    return custom->second;
   }
-  auto command_text = maybe_json.value();
-  return execute(input_text, command_text, input_file);
+  return std::nullopt;
 }
 
-auto execute(const std::string& input_text, const std::string& command_text,
-    const std::optional<std::string>& file_name,
-    const TextToCommands& text_to_commands) -> std::string {
+auto compile_commands(const Commands& commands)
+  -> tl::expected<Program, std::string> {
+  auto program = Program();
+  program.reserve(commands.size());
+  auto slots = std::array<std::unordered_map<std::string, size_t>,
+       handle_kind_count>();
+  for (const auto& command : commands) {
+    if (auto opcode = lookup_opcode(command.name)) {
+      program.push_back({*opcode, semantic_table[static_cast<size_t>(*opcode)],
+          std::nullopt});
+      auto kind = handle_kind(*opcode);
+      if (kind && command.arguments && command.arguments->size() == 1) {
+        auto& kind_slots = slots[static_cast<size_t>(*kind)];
+        program.back().slot = kind_slots.emplace((*command.arguments)[0],
+            kind_slots.size()).first->second;
+      }
+    } else if (auto custom = custom_commands().find(command.name);
+        custom != custom_commands().end()) {
+      program.push_back({Opcode::custom, custom->second, std::nullopt});
+    } else {
+      return tl::make_unexpected(std::string("compile_commands: no command "
+            "with name: ") + command.name);
+    }
+  }
+  return program;
+}
 
-  auto context = Context(std::make_pair(file_name, input_text));
-  auto maybe_commands = text_to_commands(command_text);
-  if (!maybe_commands) {
-    throw std::runtime_error(std::string("execute: unable to parse json: ")
-        + maybe_commands.error());
+// Where a command's span goes in a trace
+auto trace_category(Opcode opcode) -> std::string_view {
+  switch (opcode) {
+    case Opcode::read_in_file:
+    case Opcode::read_in_file_line:
+    case Opcode::append_to_file:
+    case Opcode::nl_append_to_file:
+      return "io";
+    case Opcode::execute:
+      return "execute";
+    default:
+      return "command";
+  }
+}
+
+// b, t, T and the restart of D, the commands jumps_taken counts
+auto counts_as_jump(Opcode opcode) -> bool {
+  return opcode == Opcode::branch || opcode == Opcode::branch_true
+    || opcode == Opcode::branch_false || opcode == Opcode::delete_restart;
+}
+
+// What run_commands calls around every cycle and command, NoInstruments
+// compiles away entirely so run_script pays nothing for run_instrumented
+struct NoInstruments {
+  static constexpr auto enabled = false;
+  auto begin_cycle(const Context&) -> void {}
+  auto end_cycle(const Context&) -> void {}
+  auto before_command(const Context&, size_t) -> void {}
+  auto after_command(const Context&, size_t) -> void {}
+};
+
+struct Instruments {
+  static constexpr auto enabled = true;
+  Instruments(Profile* profile, TraceWriter* trace, MemoryStats* memory,
+      size_t memory_sample_every, LatencyStats* latency,
+      PerfCounters* counters)
+    : profile(profile), trace(trace), memory(memory),
+      memory_sample_every(memory_sample_every), latency(latency),
+      counters(counters) {}
+
+  Profile* profile;
+  TraceWriter* trace;
+  MemoryStats* memory;
+  // print a memory_sample every this many cycles, 0 for never
+  size_t memory_sample_every;
+  LatencyStats* latency;
+  // hardware counters attributed to profile, only read when profiling
+  PerfCounters* counters;
+  std::chrono::steady_clock::time_point command_start;
+  HardwareCounts counters_start = {};
+  uint64_t cycle_start = 0;
+  uint64_t trace_command_start = 0;
+  // the cycle latency is recording, the command start is shared with profile
+  std::chrono::steady_clock::time_point latency_start;
+  SlowLine slow_line;
+  // the time each command has taken so far in the cycle, the commands of a
+  // loop run more than once; cycle_commands are the ones to look at and clear
+  std::vector<uint64_t> cycle_nanoseconds;
+  std::vector<size_t> cycle_commands;
+
+  auto begin_cycle(const Context& context) -> void {
+    if (trace) {
+      cycle_start = trace->now();
+    }
+    if (latency) {
+      slow_line = SlowLine{context.cycle, context.operations_stream
+        ? context.operations_stream->size()
+        : 0};
+      cycle_nanoseconds.resize(context.commands->size());
+      latency_start = std::chrono::steady_clock::now();
+    }
+  }
+
+  auto end_cycle(const Context& context) -> void {
+    if (trace) {
+      trace->end_cycle(context.cycle, cycle_start, trace->now());
+    }
+    if (latency) {
+      slow_line.nanoseconds = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - latency_start).count());
+      for (auto index : cycle_commands) {
+        if (cycle_nanoseconds[index] >= slow_line.command_nanoseconds) {
+          slow_line.command = index;
+          slow_line.command_nanoseconds = cycle_nanoseconds[index];
+        }
+        cycle_nanoseconds[index] = 0;
+      }
+      cycle_commands.clear();
+      latency->record(slow_line);
+    }
+    if (memory) {
+      memory->result.set(context.result.capacity());
+      memory->output_buffers.set(context.handles->write_bytes());
+      memory->input_files.set(context.handles->read_bytes());
+      if (memory_sample_every > 0 && context.cycle % memory_sample_every == 0) {
+        memory->allocations = allocation_counts();
+        std::cerr << memory_sample(context.cycle, *memory);
+      }
+    }
+  }
+
+  auto before_command(const Context& context, size_t index) -> void {
+    if (profile) {
+      const auto& command = (*context.commands)[index];
+      auto& counts = (*profile)[index];
+      counts.invocations++;
+      if (!command.address || *command.address == context.cycle) {
+        counts.address_hits++;
+      } else {
+        counts.address_skips++;
+      }
+      counts.bytes_in += context.operations_stream
+        ? context.operations_stream->size()
+        : 0;
+    }
+    if (profile && counters) {
+      counters_start = counters->read();
+    }
+    if (profile || latency) {
+      command_start = std::chrono::steady_clock::now();
+    }
+    if (trace) {
+      trace_command_start = trace->now();
+    }
   }
-  context.commands = maybe_commands.value();
 
+  auto after_command(const Context& context, size_t index) -> void {
+    auto nanoseconds = uint64_t(0);
+    if (profile || latency) {
+      nanoseconds = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - command_start).count());
+    }
+    if (latency) {
+      if (cycle_nanoseconds[index] == 0) {
+        cycle_commands.push_back(index);
+      }
+      cycle_nanoseconds[index] += nanoseconds;
+    }
+    if (profile && counters) {
+      auto end = counters->read();
+      auto& hardware = (*profile)[index].hardware;
+      for (size_t i = 0; i < hardware.size(); i++) {
+        // scaling for multiplexing can make a count go backwards a little
+        hardware[i] += end[i] > counters_start[i]
+          ? end[i] - counters_start[i]
+          : 0;
+      }
+    }
+    if (profile) {
+      auto& counts = (*profile)[index];
+      counts.nanoseconds += nanoseconds;
+      counts.bytes_out += context.operations_stream
+        ? context.operations_stream->size()
+        : 0;
+      // a branch to a missing label jumps to the end, d and q also end the
+      // script but aren't jumps
+      if (counts_as_jump((*context.program)[index].opcode)
+          && context.current_command != index) {
+        counts.jumps_taken++;
+      }
+    }
+    if (memory) {
+      memory->pattern_space.set(context.operations_stream
+          ? context.operations_stream->capacity()
+          : 0);
+      memory->hold_space.set(context.static_stream
+          ? context.static_stream->capacity()
+          : 0);
+    }
+    if (trace) {
+      trace->command((*context.commands)[index].name,
+          trace_category((*context.program)[index].opcode), index,
+          trace_command_start, trace->now());
+    }
+  }
+};
+
+// The pattern space and its newline go on the end of the output. When it is
+// still the line or lines last read, byte for byte, the output refers to them
+// in the input instead, extending the last segment when they follow on.
+auto append_cycle_output(Context& context) -> void {
+  const auto& operations = *context.operations_stream;
+  const auto& input = context.file_stream.second;
+  auto end = context.file_position;
+  auto untouched = context.output_segments && end > operations.size()
+    && input.compare(end - operations.size() - 1, operations.size(),
+        operations) == 0
+    && input[end - 1] == nl[0];
+  if (!untouched) {
+    context.result += operations;
+    context.result += nl;
+    return;
+  }
+  auto& segments = *context.output_segments;
+  auto start = end - operations.size() - 1;
+  if (!segments.empty() && segments.back().result_offset == context.result.size()
+      && segments.back().input_offset + segments.back().size == start) {
+    segments.back().size += end - start;
+  } else {
+    segments.push_back({context.result.size(), start, end - start});
+  }
+}
+
+// The one loop behind run_script and run_instrumented
+template<typename Hooks>
+auto run_commands(Context context, Hooks& hooks) -> Context {
+  auto* progress = context.handles->progress;
   size_t pos = 0;
-  while ((pos = context.file_stream.second.find(nl)) != std::string::npos) {
-    context.operations_stream = context.file_stream.second.substr(0, pos);
-    context.file_stream.second = context.file_stream.second.substr(pos + 1);
+  while ((pos = find_delimiter(context.file_stream.second, nl,
+          context.file_position)) != std::string::npos) {
+    // n and N read further lines within the cycle
+    const auto cycle_position = context.file_position;
+    const auto first_cycle = context.cycle;
+    context.operations_stream = context.file_stream.second.substr(
+        context.file_position, pos - context.file_position);
+    context.file_position = pos + 1;
     context.cycle++;
     context.last_replace_success = false;
     context.current_command = 0;
-    while (context.current_command < context.commands.size()) {
-      const auto& command = context.commands[context.current_command];
-      if (control_flow_map.contains(command.name)) {
-        auto maybe_context = control_flow_map.at(command.name)(std::move(context), command);
-        if (!maybe_context) {
-          throw std::runtime_error(std::string("execute: unable to execute command: ")
-              + maybe_context.error());
-        }
-        context = std::move(maybe_context.value());
-      } else {
-        throw std::runtime_error(std::string("execute: no command with name: ")
-            + command.name);
+    if constexpr (Hooks::enabled) {
+      hooks.begin_cycle(context);
+    }
+    while (context.current_command < context.commands->size()) {
+      const auto index = context.current_command;
+      const auto& command = (*context.commands)[index];
+      const auto function = (*context.program)[index].function;
+      if constexpr (Hooks::enabled) {
+        hooks.before_command(context, index);
+      }
+      auto maybe_context = function(std::move(context), command);
+      if (!maybe_context) {
+        throw std::runtime_error(std::string("execute: unable to execute command: ")
+            + maybe_context.error());
+      }
+      context = std::move(maybe_context.value());
+      if constexpr (Hooks::enabled) {
+        hooks.after_command(context, index);
       }
       context.current_command++;
     }
     if (context.operations_stream) {
-      context.result += (*context.operations_stream + std::string(nl));
+      append_cycle_output(context);
+    }
+    if constexpr (Hooks::enabled) {
+      hooks.end_cycle(context);
+    }
+    if (progress) {
+      progress->add(context.cycle - first_cycle,
+          context.file_position - cycle_position);
     }
+    if (context.handles->exit_code) {
+      break;
+    }
+  }
+  return context;
+}
+
+auto run_script(Context context) -> Context {
+  auto hooks = NoInstruments();
+  return run_commands(std::move(context), hooks);
+}
+
+auto run_instrumented(Context context, Profile* profile, TraceWriter* trace,
+    MemoryStats* memory, size_t memory_sample_every, LatencyStats* latency,
+    PerfCounters* counters) -> Context {
+  if (profile) {
+    profile->resize(context.commands->size());
+  }
+  auto hooks = Instruments(profile, trace, memory, memory_sample_every,
+    latency, counters);
+  context = run_commands(std::move(context), hooks);
+  if (memory) {
+    memory->allocations = allocation_counts();
+  }
+  return context;
+}
+
+auto run_profiled(Context context, Profile& profile) -> Context {
+  return run_instrumented(std::move(context), &profile, nullptr);
+}
+
+// The input and the script of execute_from_files
+auto read_input_and_script(const std::string& input_file,
+    const std::string& command_file)
+  -> std::pair<std::string, std::string> {
+  auto maybe_input = file_to_string(input_file);
+  if (!maybe_input) {
+    throw std::runtime_error(maybe_input.error());
+  }
+  auto maybe_json = file_to_string(command_file);
+  if (!maybe_json) {
+    throw std::runtime_error(maybe_json.error());
+  }
+  return {std::move(maybe_input.value()), std::move(maybe_json.value())};
+}
+
+auto execute_from_files(const std::string& input_file,
+    const std::string& command_file, const Options& options,
+    const TextToCommands& text_to_commands) -> std::string {
+  auto [input_text, command_text] = read_input_and_script(input_file,
+      command_file);
+  return execute(input_text, command_text, input_file, text_to_commands,
+      options);
+}
+
+auto execute_from_files_into(const OutputWriter& writer,
+    const std::string& input_file, const std::string& command_file,
+    const Options& options, const TextToCommands& text_to_commands) -> int {
+  auto [input_text, command_text] = read_input_and_script(input_file,
+      command_file);
+  return execute_into(writer, input_text, command_text, input_file, text_to_commands,
+      options);
+}
+
+// Runs through run_instrumented, then writes out what it measured
+auto run_measured(Context context, const Options& options, TraceWriter* trace)
+  -> std::string {
+  auto measure_memory = options.memory_stats || options.memory_sample_every > 0;
+  auto profile = Profile();
+  auto memory = MemoryStats();
+  auto latency = LatencyStats(options.slow_lines);
+  auto counters = std::unique_ptr<PerfCounters>();
+  if (options.profile_counters && options.profile != ProfileOutput::none) {
+    if (auto opened = PerfCounters::open(); opened) {
+      counters = std::move(opened.value());
+    } else {
+      std::cerr << "execute: warning: hardware counters unavailable, "
+        "profiling with timers only: " << opened.error() << std::endl;
+    }
+  }
+  context = run_instrumented(std::move(context),
+      options.profile != ProfileOutput::none ? &profile : nullptr,
+      trace, measure_memory ? &memory : nullptr,
+      options.memory_sample_every, options.latency ? &latency : nullptr,
+      counters.get());
+  auto flush_start = trace ? trace->now() : 0;
+  if (auto flushed = context.handles->output_files.flush(); !flushed) {
+    throw std::runtime_error(std::string("execute: unable to write output "
+          "files: ") + flushed.error());
+  }
+  if (trace) {
+    trace->span("flush output files", "io", flush_start, trace->now());
+    if (auto closed = trace->close(); !closed) {
+      throw std::runtime_error(std::string("execute: unable to write trace "
+            "to: ") + options.trace_file);
+    }
+  }
+  if (options.memory_stats) {
+    std::cerr << memory_report(memory);
+  }
+  if (options.latency) {
+    std::cerr << latency_report(*context.commands, latency);
+  }
+  if (options.profile == ProfileOutput::none) {
+    return context.result;
+  } else if (options.profile == ProfileOutput::report) {
+    std::cerr << profile_report(*context.commands, profile);
+  } else {
+    auto file = std::ofstream(options.profile_file);
+    if (!(file << profile_json(*context.commands, profile))) {
+      throw std::runtime_error(std::string("execute: unable to write "
+            "profile to: ") + options.profile_file);
+    }
+  }
+  return context.result;
+}
+
+// Picks how to run a loaded script from options and what the script does
+auto run_loaded(Context context, const Options& options, TraceWriter* trace)
+  -> std::string {
+  if (options.profile != ProfileOutput::none || trace || options.memory_stats
+      || options.memory_sample_every > 0 || options.latency) {
+    return run_measured(std::move(context), options, trace);
+  }
+
+  auto batched = options.batch
+    && is_batchable(*context.commands, *context.program);
+  auto runner = batched ? ScriptRunner(run_batched) : ScriptRunner(run_script);
+  if (options.exec_jobs != 1
+      && is_exec_local(*context.commands, *context.program)) {
+    return execute_exec_pool(std::move(context), options);
+  }
+  if (options.threads != 1
+      && is_line_local(*context.commands, *context.program)) {
+    return execute_parallel(std::move(context), options, runner);
+  }
+  context = runner(std::move(context));
+  if (auto flushed = context.handles->output_files.flush(); !flushed) {
+    throw std::runtime_error(std::string("execute: unable to write output "
+          "files: ") + flushed.error());
   }
   return context.result;
 }
+
+auto write_output(const OutputWriter& writer,
+    std::span<const std::string_view> pieces) -> void {
+  if (!writer(pieces)) {
+    throw std::runtime_error("execute: unable to write output");
+  }
+}
+
+auto run_loaded_into(Context context, const Options& options,
+    TraceWriter* trace, const OutputWriter& writer) -> int {
+  auto handles = context.handles;
+  auto serial = options.profile == ProfileOutput::none && !trace
+    && !options.memory_stats && options.memory_sample_every == 0
+    && !options.latency
+    && !(options.batch && is_batchable(*context.commands, *context.program))
+    && !(options.exec_jobs != 1
+        && is_exec_local(*context.commands, *context.program))
+    && !(options.threads != 1
+        && is_line_local(*context.commands, *context.program));
+  if (!serial) {
+    auto result = run_loaded(std::move(context), options, trace);
+    auto piece = std::string_view(result);
+    write_output(writer, std::span(&piece, 1));
+    return handles->exit_code.value_or(0);
+  }
+
+  context.output_segments.emplace();
+  context = run_script(std::move(context));
+  if (auto flushed = context.handles->output_files.flush(); !flushed) {
+    throw std::runtime_error(std::string("execute: unable to write output "
+          "files: ") + flushed.error());
+  }
+  write_output(writer, output_pieces(context.file_stream.second,
+        context.result, *context.output_segments));
+  return handles->exit_code.value_or(0);
+}
+
+// Loads the script for execute and execute_into, then hands the loaded
+// Context and the trace to run
+template<typename Run>
+auto execute_with(const std::string& input_text,
+    const std::string& command_text,
+    const std::optional<std::string>& file_name,
+    const TextToCommands& text_to_commands, const Options& options, Run run) {
+
+  auto trace = std::unique_ptr<TraceWriter>();
+  if (!options.trace_file.empty()) {
+    auto maybe_trace = TraceWriter::open(options.trace_file,
+        options.trace_sample_every, options.trace_threshold);
+    if (!maybe_trace) {
+      throw std::runtime_error(std::string("execute: unable to open trace: ")
+          + maybe_trace.error());
+    }
+    trace = std::move(maybe_trace.value());
+  }
+  auto load_start = trace ? trace->now() : 0;
+
+  auto context = Context(std::make_pair(file_name, input_text));
+  auto cache_key = options.script_cache_dir.empty()
+    ? std::string()
+    : script_cache_key(command_text, options.optimize);
+  auto cached = cache_key.empty()
+    ? std::nullopt
+    : load_cached_script(options.script_cache_dir, cache_key, command_text);
+  if (cached) {
+    context.commands = std::make_shared<const Commands>(
+        std::move(cached->commands));
+    context.program = std::make_shared<const Program>(
+        std::move(cached->program));
+  } else {
+    auto maybe_commands = text_to_commands(command_text);
+    if (!maybe_commands) {
+      throw std::runtime_error(std::string("execute: unable to parse json: ")
+          + maybe_commands.error());
+    }
+    context.commands = std::make_shared<const Commands>(options.optimize
+        ? optimize_commands(maybe_commands.value())
+        : std::move(maybe_commands.value()));
+    auto maybe_program = compile_commands(*context.commands);
+    if (!maybe_program) {
+      throw std::runtime_error(std::string("execute: unable to load script: ")
+          + maybe_program.error());
+    }
+    context.program = std::make_shared<const Program>(
+        std::move(maybe_program.value()));
+    if (!cache_key.empty()) {
+      if (auto stored = store_cached_script(options.script_cache_dir,
+            cache_key, command_text, *context.commands, *context.program);
+          !stored) {
+        std::cerr << "execute: warning: unable to cache script: "
+          << stored.error() << std::endl;
+      }
+    }
+  }
+  auto maybe_handles = open_handles(*context.commands, *context.program,
+      options);
+  if (!maybe_handles) {
+    throw std::runtime_error(std::string("execute: unable to load script: ")
+        + maybe_handles.error());
+  }
+  context.handles = std::move(maybe_handles.value());
+  if (trace) {
+    trace->span("load script", "load", load_start, trace->now());
+  }
+
+  auto progress = ProgressCounters();
+  auto reporter = std::optional<ProgressReporter>();
+  if (options.progress) {
+    context.handles->progress = &progress;
+    reporter.emplace(progress, input_text.size(), options.progress_interval,
+        options.progress_file);
+  }
+
+  auto result = run(std::move(context), trace.get());
+  if (reporter) {
+    reporter->finish();
+  }
+  return result;
+}
+
+auto execute(const std::string& input_text, const std::string& command_text,
+    const std::optional<std::string>& file_name,
+    const TextToCommands& text_to_commands,
+    const Options& options) -> std::string {
+  return execute_with(input_text, command_text, file_name, text_to_commands,
+      options, [&options](Context context, TraceWriter* trace) {
+        return run_loaded(std::move(context), options, trace);
+      });
+}
+
+auto execute_into(const OutputWriter& writer, const std::string& input_text,
+    const std::string& command_text,
+    const std::optional<std::string>& file_name,
+    const TextToCommands& text_to_commands, const Options& options) -> int {
+  return execute_with(input_text, command_text, file_name, text_to_commands,
+      options, [&options, &writer](Context context, TraceWriter* trace) {
+        return run_loaded_into(std::move(context), options, trace, writer);
+      });
+}
@@ -3,8 +3,8 @@
 #if defined(__linux__)
 #include <cstdio>
 #endif
-#include <fstream>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <tl/expected.hpp>
@@ -12,7 +12,16 @@
 #include <variant>
 #include <vector>
 
+#include "CommandTable.h"
+#include "HandleTable.h"
+#include "Latency.h"
+#include "LineReader.h"
+#include "MemoryStats.h"
+#include "Options.h"
+#include "Output.h"
 #include "Parsing.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 #if defined(_WIN32) || defined(_WIN64)
   static constexpr auto nl = "\r\n";
@@ -20,89 +29,154 @@
   static constexpr auto nl = "\n";
 #endif
 
-using TextToCommands = std::function<ResultCommands(const std::string&)>;
+// We want to be able to handle/give context to errors when running sim
+// scripts
+struct Context;
+using ResultContext = tl::expected<Context, std::string>;
+using SemanticFunc = auto (*)(Context, const Command&) -> ResultContext;
+
+// What each Command resolves to when the script is loaded, indexed the same as
+// Context::commands.
+struct CompiledCommand {
+  Opcode opcode;
+  SemanticFunc function;
+  // for commands naming a file, its index in Context::handles' table for that
+  // kind of file (see handle_kind)
+  std::optional<size_t> slot;
+};
+using Program = std::vector<CompiledCommand>;
+
+// Adds a command to sim at runtime, returns false if the name is already taken
+// by a builtin or a previously registered command. Register before calling
+// execute, the registry is not synchronized.
+auto register_command(const std::string& name, SemanticFunc function) -> bool;
+auto compile_commands(const Commands& commands)
+  -> tl::expected<Program, std::string>;
+// What compile_commands gives a command with opcode, custom commands are looked
+// up by name and are nullopt when not registered
+auto semantic_function(Opcode opcode, const std::string& name)
+  -> std::optional<SemanticFunc>;
+// Opens every file the compiled script names, see HandleTable
+auto open_handles(const Commands& commands, const Program& program,
+    const Options& options)
+  -> tl::expected<std::shared_ptr<HandleTable>, std::string>;
+
+// Shared with the batch executor so both agree on the semantics
+auto find_label_index(const Context& context,
+    const std::string label) -> std::optional<uint64_t>;
+auto translate_operations(std::string& operations, const std::string& from,
+    const std::string& to) -> void;
+
+// Runs the compiled script over every line of context.file_stream, the output
+// is left in the returned Context's result.
+auto run_script(Context context) -> Context;
+// run_script, counting what every command does into profile, recording spans
+// into trace, measuring memory into memory and every cycle's time into
+// latency, any of which can be nullptr. With counters every command's
+// hardware counts go into profile too.
+auto run_instrumented(Context context, Profile* profile, TraceWriter* trace,
+    MemoryStats* memory = nullptr, size_t memory_sample_every = 0,
+    LatencyStats* latency = nullptr, PerfCounters* counters = nullptr)
+  -> Context;
+auto run_profiled(Context context, Profile& profile) -> Context;
+using ScriptRunner = auto (*)(Context) -> Context;
+// Runs a Context with its script compiled and handles open, through whichever
+// executor options and the script call for, and flushes its output files.
+// trace can be nullptr.
+auto run_loaded(Context context, const Options& options, TraceWriter* trace)
+  -> std::string;
+// run_loaded, handing the output to writer instead of returning it. Run
+// serially, lines the script leaves as they were are written straight from
+// the input rather than copied into the result first. Returns the exit code
+// quit gave, 0 if the script didn't quit.
+auto run_loaded_into(Context context, const Options& options,
+    TraceWriter* trace, const OutputWriter& writer) -> int;
 
 auto execute_from_files(const std::string& input_file,
-    const std::string& command_file) -> std::string;
+    const std::string& command_file,
+    const Options& options = Options(),
+    const TextToCommands& text_to_commands = parse_json) -> std::string;
 auto execute(const std::string& input_text, const std::string& command_text,
     const std::optional<std::string>& file_name = std::nullopt,
-    const TextToCommands& text_to_commands = parse_json) -> std::string;
+    const TextToCommands& text_to_commands = parse_json,
+    const Options& options = Options()) -> std::string;
+// execute and execute_from_files, writing the output to writer as it's made
+// rather than returning it, returning the exit code as run_loaded_into does
+auto execute_into(const OutputWriter& writer, const std::string& input_text,
+    const std::string& command_text,
+    const std::optional<std::string>& file_name = std::nullopt,
+    const TextToCommands& text_to_commands = parse_json,
+    const Options& options = Options()) -> int;
+auto execute_from_files_into(const OutputWriter& writer,
+    const std::string& input_file, const std::string& command_file,
+    const Options& options = Options(),
+    const TextToCommands& text_to_commands = parse_json) -> int;
 
 struct Context {
   // optional for testing purposes, we want to be calling execute over
   // execute_from_files, want to rely as little as possible on file io as it
   // makes stuff more complicated.
   std::pair<std::optional<std::string>, std::string> file_stream;
-  std::unordered_map<std::string, std::fstream> stream_map;
+  // where the next line of file_stream starts, what comes before has been read
+  size_t file_position;
+  // every file the script reads or writes, shared between copies
+  std::shared_ptr<HandleTable> handles;
   std::optional<std::string> operations_stream;
   std::optional<std::string> static_stream;
-  Commands commands;
+  // the compiled script, shared by every copy and every run of an Engine
+  std::shared_ptr<const Commands> commands;
+  std::shared_ptr<const Program> program;
   std::string result;
+  // when set, cycles which leave their lines untouched add a segment of
+  // file_stream here instead of copying the lines into result
+  std::optional<OutputSegments> output_segments;
   uint64_t cycle;
   uint64_t current_command;
   bool last_replace_success;
 
   Context(const std::pair<std::optional<std::string>, std::string>& file_stream)
     : file_stream(file_stream),
-      stream_map(std::unordered_map<std::string, std::fstream>()),
+      file_position(0),
+      handles(std::make_shared<HandleTable>(Options())),
       operations_stream(std::nullopt),
       static_stream(std::nullopt),
-      commands(Commands()),
+      commands(std::make_shared<const Commands>()),
+      program(std::make_shared<const Program>()),
       result(std::string()),
+      output_segments(std::nullopt),
       cycle(0),
       current_command(0),
       last_replace_success(false) {}
 
-  // destructor
-  ~Context() {
-    for (auto& [name, stream] : stream_map) {
-      stream.close();
-    }
-  }
-
   // copy constructor
-  // N.B. other is not const because tellg can put it into an error state :(
-  // But with the way the program is written, you shouldn't really be copying a
-  // Context anyways
-  Context(Context& other)
+  // N.B. with the way the program is written, you shouldn't really be copying
+  // a Context anyways, and the copy shares its files with the original
+  Context(const Context& other)
     : file_stream(other.file_stream),
-      stream_map(std::unordered_map<std::string, std::fstream>()),
+      file_position(other.file_position),
+      handles(other.handles),
       operations_stream(other.operations_stream),
       static_stream(other.static_stream),
       commands(other.commands),
+      program(other.program),
       result(other.result),
+      output_segments(other.output_segments),
       cycle(other.cycle),
       current_command(other.current_command),
-      last_replace_success(other.last_replace_success) {
-        for (auto& [name, stream] : other.stream_map) {
-          stream_map[name] = std::fstream(name);
-          if (!stream_map[name]) {
-            throw std::runtime_error(std::string("Copy Constructor: Unable "
-                  "to open file: ") + name);
-          }
-          stream_map[name].seekg(stream.tellg());
-        }
-      }
+      last_replace_success(other.last_replace_success) {}
 
   // copy assignment
-  // N.B. other is not const because tellg can put it into an error state :(
-  // But with the way the program is written, you shouldn't really be copying a
-  // Context anyways
-  auto operator=(Context& other) -> Context& {
+  auto operator=(const Context& other) -> Context& {
     if (this != &other) {
       file_stream = other.file_stream;
-      for (auto& [name, stream] : other.stream_map) {
-        stream_map[name] = std::fstream(name);
-        if (!stream_map[name]) {
-          throw std::runtime_error(std::string("Copy Assignment: Unable "
-                "to open file: ") + name);
-        }
-        stream_map[name].seekg(stream.tellg());
-      }
+      file_position = other.file_position;
+      handles = other.handles;
       operations_stream = other.operations_stream;
       static_stream = other.static_stream;
       commands = other.commands;
+      program = other.program;
       result = other.result;
+      output_segments = other.output_segments;
       cycle = other.cycle;
       current_command = other.current_command;
       last_replace_success = other.last_replace_success;
@@ -112,12 +186,15 @@ struct Context {
 
   // move constructor
   Context(Context&& other) noexcept
-    : file_stream(other.file_stream),
-      stream_map(std::move(other.stream_map)),
+    : file_stream(std::move(other.file_stream)),
+      file_position(other.file_position),
+      handles(std::move(other.handles)),
       operations_stream(std::move(other.operations_stream)),
       static_stream(std::move(other.static_stream)),
       commands(std::move(other.commands)),
+      program(std::move(other.program)),
       result(std::move(other.result)),
+      output_segments(std::move(other.output_segments)),
       cycle(other.cycle),
       current_command(other.current_command),
       last_replace_success(other.last_replace_success) {}
@@ -125,12 +202,15 @@ struct Context {
   // move assignment
   auto operator=(Context&& other) noexcept -> Context& {
     if (this != &other) {
-      file_stream = other.file_stream;
-      stream_map = std::move(other.stream_map);
+      file_stream = std::move(other.file_stream);
+      file_position = other.file_position;
+      handles = std::move(other.handles);
       operations_stream = std::move(other.operations_stream);
       static_stream = std::move(other.static_stream);
       commands = std::move(other.commands);
+      program = std::move(other.program);
       result = std::move(other.result);
+      output_segments = std::move(other.output_segments);
       cycle = other.cycle;
       current_command = other.current_command;
       last_replace_success = other.last_replace_success;
@@ -0,0 +1,390 @@
+#include "Daemon.h"
+
+#include <array>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Output.h"
+#include "Parsing.h"
+#include "ScriptCache.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Compiled scripts kept before the oldest is dropped
+constexpr static auto max_cached_scripts = size_t(1024);
+constexpr static auto read_block_bytes = size_t(1) << 16;
+// script_cache_key is a few dozen bytes, anything much longer isn't one
+constexpr static auto max_key_bytes = uint32_t(256);
+
+// What a job starts with, the key follows, the input, output and script file
+// descriptors ride along with the header
+struct JobHeader {
+  uint32_t magic;
+  uint32_t flags;
+  uint32_t key_size;
+};
+// Sent back once the job is done, an error message of message_size follows.
+// exit_code is what quit gave the run, 0 if it didn't quit or failed.
+struct JobStatus {
+  uint32_t failed;
+  uint32_t exit_code;
+  uint32_t message_size;
+};
+constexpr static auto job_magic = uint32_t(0x4a4d4953);
+// JobHeader::flags, the options a job picks for itself
+constexpr static auto job_optimize = uint32_t(1);
+constexpr static auto job_fds = size_t(3);
+
+#if defined(__linux__)
+auto socket_address(const std::string& socket_path)
+  -> tl::expected<sockaddr_un, std::string> {
+  auto address = sockaddr_un();
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    return tl::make_unexpected("Daemon: socket path too long: " + socket_path);
+  }
+  std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+  return address;
+}
+
+auto read_exactly(int fd, char* data, size_t size) -> bool {
+  while (size > 0) {
+    auto count = ::read(fd, data, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= static_cast<size_t>(count);
+  }
+  return true;
+}
+
+// Everything left in fd, from offset if given (so a file the client has read
+// from is read again from the start)
+auto read_fd(int fd, std::optional<off_t> offset = std::nullopt)
+  -> tl::expected<std::string, std::string> {
+  auto contents = std::string();
+  auto block = std::array<char, read_block_bytes>();
+  while (true) {
+    auto count = offset
+      ? ::pread(fd, block.data(), block.size(), *offset)
+      : ::read(fd, block.data(), block.size());
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count < 0) {
+      return tl::make_unexpected(std::string("unable to read: ")
+          + std::strerror(errno));
+    } else if (count == 0) {
+      return contents;
+    }
+    contents.append(block.data(), static_cast<size_t>(count));
+    if (offset) {
+      *offset += count;
+    }
+  }
+}
+
+auto send_status(int connection, const tl::expected<int, std::string>& ran)
+  -> void {
+  auto error = ran ? std::string() : ran.error();
+  auto status = JobStatus{ran ? 0u : 1u,
+    static_cast<uint32_t>(ran.value_or(0)),
+    static_cast<uint32_t>(error.size())};
+  auto message = std::string(reinterpret_cast<const char*>(&status),
+      sizeof(status)) + error;
+  write_all(connection, message);
+}
+#endif
+
+auto Daemon::listen(const std::string& socket_path, const Options& options,
+    size_t workers, std::chrono::milliseconds job_timeout)
+  -> tl::expected<std::unique_ptr<Daemon>, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("Daemon: only supported for linux");
+#else
+  auto address = socket_address(socket_path);
+  if (!address) {
+    return tl::make_unexpected(address.error());
+  }
+  auto daemon = std::unique_ptr<Daemon>(new Daemon());
+  daemon->socket_path = socket_path;
+  daemon->options = options;
+  daemon->job_timeout = job_timeout;
+  daemon->workers = workers == 0
+    ? std::max(1u, std::thread::hardware_concurrency())
+    : workers;
+  daemon->listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (daemon->listener < 0) {
+    return tl::make_unexpected("Daemon: socket() failed");
+  }
+  ::unlink(socket_path.c_str());
+  if (::bind(daemon->listener, reinterpret_cast<sockaddr*>(&*address),
+        sizeof(*address)) != 0 || ::listen(daemon->listener, SOMAXCONN) != 0) {
+    return tl::make_unexpected("Daemon: unable to listen on: " + socket_path
+        + ": " + std::strerror(errno));
+  }
+  return daemon;
+#endif
+}
+
+Daemon::~Daemon() {
+#if defined(__linux__)
+  stop();
+  if (listener >= 0) {
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+  }
+  for (auto connection : jobs) {
+    ::close(connection);
+  }
+#endif
+}
+
+auto Daemon::stop() -> void {
+#if defined(__linux__)
+  // only async signal safe calls, accept returns once the listener is shut
+  // down and serve takes it from there
+  ::shutdown(listener, SHUT_RDWR);
+#endif
+}
+
+auto Daemon::serve() -> void {
+#if defined(__linux__)
+  auto pool = std::vector<std::thread>();
+  for (size_t i = 0; i < workers; i++) {
+    pool.emplace_back(&Daemon::work, this);
+  }
+  while (true) {
+    auto connection = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (connection < 0 && (errno == EINTR || errno == ECONNABORTED)) {
+      continue;
+    } else if (connection < 0) {
+      break;
+    }
+    // the header and key are read with this timeout, a client which never
+    // sends them fails its job instead of blocking a worker
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+        job_timeout);
+    auto timeout = timeval{static_cast<time_t>(seconds.count()),
+      static_cast<suseconds_t>(std::chrono::duration_cast<
+          std::chrono::microseconds>(job_timeout - seconds).count())};
+    ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+        sizeof(timeout));
+    auto lock = std::lock_guard(jobs_mutex);
+    jobs.push_back(connection);
+    jobs_changed.notify_one();
+  }
+  {
+    auto lock = std::lock_guard(jobs_mutex);
+    stopping = true;
+    jobs_changed.notify_all();
+  }
+  for (auto& worker : pool) {
+    worker.join();
+  }
+#endif
+}
+
+auto Daemon::work() -> void {
+#if defined(__linux__)
+  while (true) {
+    auto lock = std::unique_lock(jobs_mutex);
+    jobs_changed.wait(lock, [this]() { return stopping || !jobs.empty(); });
+    if (jobs.empty()) {
+      return;
+    }
+    auto connection = jobs.front();
+    jobs.pop_front();
+    lock.unlock();
+
+    auto ran = run_job(connection);
+    send_status(connection, ran);
+    ::close(connection);
+  }
+#endif
+}
+
+auto Daemon::run_job(int connection) -> tl::expected<int, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("Daemon: only supported for linux");
+#else
+  auto header = JobHeader();
+  auto iov = iovec{&header, sizeof(header)};
+  alignas(cmsghdr) auto control = std::array<char, CMSG_SPACE(
+      job_fds * sizeof(int))>();
+  auto message = msghdr();
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+  auto received = ::recvmsg(connection, &message,
+      MSG_WAITALL | MSG_CMSG_CLOEXEC);
+
+  // take ownership of whatever came across before looking at anything else
+  auto fds = std::vector<int>();
+  for (auto* cmsg = CMSG_FIRSTHDR(&message); cmsg;
+      cmsg = CMSG_NXTHDR(&message, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto* data = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+      fds.insert(fds.end(), data, data + count);
+    }
+  }
+  struct Closer {
+    std::vector<int>& fds;
+    ~Closer() {
+      for (auto fd : fds) {
+        ::close(fd);
+      }
+    }
+  } closer{fds};
+
+  if (received != static_cast<ssize_t>(sizeof(header))
+      || header.magic != job_magic) {
+    return tl::make_unexpected("Daemon: malformed job");
+  }
+  if (fds.size() != job_fds || (message.msg_flags & MSG_CTRUNC)) {
+    return tl::make_unexpected("Daemon: a job needs the input, output and "
+        "script file descriptors");
+  }
+  if (header.key_size > max_key_bytes) {
+    return tl::make_unexpected("Daemon: malformed job");
+  }
+  auto key = std::string(header.key_size, '\0');
+  if (!read_exactly(connection, key.data(), key.size())) {
+    return tl::make_unexpected("Daemon: malformed job");
+  }
+
+  auto engine = engine_for(key, header.flags & job_optimize, fds[2]);
+  if (!engine) {
+    return tl::make_unexpected(engine.error());
+  }
+  auto input = read_fd(fds[0]);
+  if (!input) {
+    return tl::make_unexpected("Daemon: input: " + input.error());
+  }
+  return (*engine)->run(*input, fds[1]);
+#endif
+}
+
+auto Daemon::engine_for(const std::string& key, bool optimize, int script_fd)
+  -> tl::expected<std::shared_ptr<const Engine>, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("Daemon: only supported for linux");
+#else
+  {
+    auto lock = std::lock_guard(engines_mutex);
+    if (auto found = engines.find(key); found != engines.end()) {
+      return found->second;
+    }
+  }
+  // compiled outside the lock, two jobs racing on a new script both compile it
+  auto text = read_fd(script_fd, off_t(0));
+  if (!text) {
+    return tl::make_unexpected("Daemon: script: " + text.error());
+  }
+  if (script_cache_key(*text, optimize) != key) {
+    return tl::make_unexpected("Daemon: the script doesn't match its key");
+  }
+  auto job_options = options;
+  job_options.optimize = optimize;
+  auto engine = Engine::compile(*text, job_options);
+  if (!engine) {
+    return tl::make_unexpected(engine.error());
+  }
+  auto shared = std::make_shared<const Engine>(std::move(engine.value()));
+
+  auto lock = std::lock_guard(engines_mutex);
+  if (engines.emplace(key, shared).second) {
+    engine_order.push_back(key);
+    if (engine_order.size() > max_cached_scripts) {
+      engines.erase(engine_order.front());
+      engine_order.pop_front();
+    }
+  }
+  return shared;
+#endif
+}
+
+auto Daemon::cached_scripts() -> size_t {
+  auto lock = std::lock_guard(engines_mutex);
+  return engines.size();
+}
+
+auto run_remote(const std::string& socket_path, const std::string& script_file,
+    int input_fd, int output_fd, bool optimize)
+  -> tl::expected<int, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("run_remote: only supported for linux");
+#else
+  auto script = file_to_string(script_file);
+  if (!script) {
+    return tl::make_unexpected(script.error());
+  }
+  auto key = script_cache_key(*script, optimize);
+  auto script_fd = ::open(script_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (script_fd < 0) {
+    return tl::make_unexpected("run_remote: unable to open: " + script_file);
+  }
+  auto address = socket_address(socket_path);
+  auto connection = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  auto connected = address && connection >= 0
+    && ::connect(connection, reinterpret_cast<sockaddr*>(&*address),
+        sizeof(*address)) == 0;
+  if (!connected) {
+    auto error = std::string(std::strerror(errno));
+    ::close(script_fd);
+    if (connection >= 0) {
+      ::close(connection);
+    }
+    return tl::make_unexpected("run_remote: unable to connect to: "
+        + socket_path + ": " + (address ? error : address.error()));
+  }
+
+  auto header = JobHeader{job_magic, optimize ? job_optimize : 0,
+    static_cast<uint32_t>(key.size())};
+  auto iov = iovec{&header, sizeof(header)};
+  alignas(cmsghdr) auto control = std::array<char, CMSG_SPACE(
+      job_fds * sizeof(int))>();
+  auto message = msghdr();
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+  auto* cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(job_fds * sizeof(int));
+  auto fds = std::array<int, job_fds>{input_fd, output_fd, script_fd};
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+
+  auto sent = ::sendmsg(connection, &message, MSG_NOSIGNAL)
+    == static_cast<ssize_t>(sizeof(header)) && write_all(connection, key);
+  // the daemon has its own copies now
+  ::close(script_fd);
+  auto status = JobStatus();
+  auto answered = sent && read_exactly(connection,
+      reinterpret_cast<char*>(&status), sizeof(status));
+  auto error = std::string(answered ? status.message_size : 0, '\0');
+  answered = answered && read_exactly(connection, error.data(), error.size());
+  ::close(connection);
+  if (!answered) {
+    return tl::make_unexpected("run_remote: the daemon hung up");
+  } else if (status.failed) {
+    return tl::make_unexpected(error);
+  }
+  return static_cast<int>(status.exit_code);
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tl/expected.hpp>
+#include <unordered_map>
+
+#include "Engine.h"
+#include "Options.h"
+
+// sim kept running behind a unix domain socket, so a job costs a connect
+// rather than starting a process, parsing the script and opening its files.
+//
+// A job is one connection. The client sends the script's cache key (see
+// script_cache_key) and three file descriptors with SCM_RIGHTS: the input,
+// where the output goes and the script itself. The daemon reads the input
+// and writes the output through those directly, nothing but the key and a
+// status (with the exit code the script quit with) goes over the socket. The
+// script is only read when its key isn't cached already. Jobs run on a pool
+// of workers, each is an Engine::run so they share nothing but the compiled
+// script.
+//
+// Files the script names are relative to the daemon's working directory, not
+// the client's. Linux only, like execute.
+class Daemon {
+public:
+  // Binds socket_path, replacing whatever is there. options are what every
+  // job runs with, besides optimize which the client picks.
+  // A client which hasn't sent its job within job_timeout of connecting is
+  // dropped, so it can't hold a worker.
+  static auto listen(const std::string& socket_path, const Options& options,
+      size_t workers,
+      std::chrono::milliseconds job_timeout = std::chrono::seconds(10))
+    -> tl::expected<std::unique_ptr<Daemon>, std::string>;
+  // Stops serving and removes the socket
+  ~Daemon();
+
+  Daemon(const Daemon&) = delete;
+  auto operator=(const Daemon&) -> Daemon& = delete;
+
+  // Accepts and runs jobs until stop is called, jobs already accepted are run
+  // before it returns
+  auto serve() -> void;
+  // Safe to call from any thread, or a signal handler
+  auto stop() -> void;
+
+  auto cached_scripts() -> size_t;
+
+private:
+  Daemon() = default;
+
+  auto work() -> void;
+  auto run_job(int connection) -> tl::expected<int, std::string>;
+  auto engine_for(const std::string& key, bool optimize, int script_fd)
+    -> tl::expected<std::shared_ptr<const Engine>, std::string>;
+
+  std::string socket_path;
+  Options options;
+  size_t workers = 1;
+  std::chrono::milliseconds job_timeout;
+  int listener = -1;
+
+  std::mutex jobs_mutex;
+  std::condition_variable jobs_changed;
+  std::deque<int> jobs;
+  bool stopping = false;
+
+  // compiled scripts by key, the oldest dropped once there are too many
+  std::mutex engines_mutex;
+  std::unordered_map<std::string, std::shared_ptr<const Engine>> engines;
+  std::deque<std::string> engine_order;
+};
+
+// Runs script_file over input_fd, writing to output_fd, on the daemon
+// listening at socket_path, returns the exit code the script quit with
+auto run_remote(const std::string& socket_path, const std::string& script_file,
+    int input_fd, int output_fd, bool optimize)
+  -> tl::expected<int, std::string>;
@@ -0,0 +1,110 @@
+#include "Engine.h"
+
+#include "Context.h"
+#include "Optimizer.h"
+
+struct Engine::Script {
+  Options options;
+  // handed to every run's Context as they are, never copied
+  std::shared_ptr<const Commands> commands;
+  std::shared_ptr<const Program> program;
+};
+
+Engine::Engine(std::shared_ptr<const Script> script)
+  : script(std::move(script)) {}
+
+auto Engine::compile(const std::string& command_text, const Options& options,
+    const TextToCommands& text_to_commands)
+  -> tl::expected<Engine, std::string> {
+  auto script = std::make_shared<Script>();
+  script->options = options;
+  // parse_json throws on text which isn't json at all
+  auto maybe_commands = ResultCommands();
+  try {
+    maybe_commands = text_to_commands(command_text);
+  } catch (const std::exception& exception) {
+    return tl::make_unexpected(std::string("Engine: unable to parse json: ")
+        + exception.what());
+  }
+  if (!maybe_commands) {
+    return tl::make_unexpected(std::string("Engine: unable to parse json: ")
+        + maybe_commands.error());
+  }
+  script->commands = std::make_shared<const Commands>(options.optimize
+      ? optimize_commands(maybe_commands.value())
+      : std::move(maybe_commands.value()));
+  auto maybe_program = compile_commands(*script->commands);
+  if (!maybe_program) {
+    return tl::make_unexpected(std::string("Engine: unable to load script: ")
+        + maybe_program.error());
+  }
+  script->program = std::make_shared<const Program>(
+      std::move(maybe_program.value()));
+  return Engine(std::move(script));
+}
+
+// A Context for one run of the script over input, with its own files
+auto load_context(const Options& options,
+    const std::shared_ptr<const Commands>& commands,
+    const std::shared_ptr<const Program>& program, std::string_view input)
+  -> tl::expected<Context, std::string> {
+  auto context = Context(std::make_pair(std::nullopt, std::string(input)));
+  context.commands = commands;
+  context.program = program;
+  auto maybe_handles = open_handles(*context.commands, *context.program,
+      options);
+  if (!maybe_handles) {
+    return tl::make_unexpected(std::string("Engine: unable to load script: ")
+        + maybe_handles.error());
+  }
+  context.handles = std::move(maybe_handles.value());
+  return context;
+}
+
+auto Engine::run(std::string_view input, const Sink& sink) const
+  -> tl::expected<int, std::string> {
+  return run_into(input, [&sink](std::span<const std::string_view> pieces) {
+    for (auto piece : pieces) {
+      sink(piece);
+    }
+    return true;
+  });
+}
+
+auto Engine::run(std::string_view input, int fd) const
+  -> tl::expected<int, std::string> {
+  return run_into(input, fd_writer(fd));
+}
+
+auto Engine::run_into(std::string_view input, const OutputWriter& writer) const
+  -> tl::expected<int, std::string> {
+  auto context = load_context(script->options, script->commands,
+      script->program, input);
+  if (!context) {
+    return tl::make_unexpected(context.error());
+  }
+  try {
+    return run_loaded_into(std::move(context.value()), script->options,
+        nullptr, writer);
+  } catch (const std::exception& exception) {
+    return tl::make_unexpected(std::string("Engine: ") + exception.what());
+  }
+}
+
+auto Engine::run(std::string_view input) const
+  -> tl::expected<std::string, std::string> {
+  auto context = load_context(script->options, script->commands,
+      script->program, input);
+  if (!context) {
+    return tl::make_unexpected(context.error());
+  }
+  try {
+    return run_loaded(std::move(context.value()), script->options, nullptr);
+  } catch (const std::exception& exception) {
+    return tl::make_unexpected(std::string("Engine: ") + exception.what());
+  }
+}
+
+auto Engine::commands() const -> const Commands& {
+  return *script->commands;
+}
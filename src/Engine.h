@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+#include "Options.h"
+#include "Output.h"
+#include "Parsing.h"
+
+// A script parsed and compiled once, then run over any number of inputs. This
+// is what libsim exposes for embedding sim, execute is the same thing for a
+// single input.
+//
+// An Engine is immutable once compiled, copies share the compiled script and
+// run may be called from any number of threads at once. Every run gets its
+// own pattern space, hold space and files, the same as a separate execute
+// would, so a script writing to a file has every run append to it.
+class Engine {
+public:
+  // Gets the output of a run in order, in pieces once the run is done. Lines
+  // the script left alone may come straight out of the input.
+  using Sink = std::function<void(std::string_view)>;
+
+  static auto compile(const std::string& command_text,
+      const Options& options = Options(),
+      const TextToCommands& text_to_commands = parse_json)
+    -> tl::expected<Engine, std::string>;
+
+  // The exit code quit gave, 0 if the script didn't quit
+  auto run(std::string_view input, const Sink& sink) const
+    -> tl::expected<int, std::string>;
+  // The output alone, for the exit code use one of the other runs
+  auto run(std::string_view input) const -> tl::expected<std::string, std::string>;
+  // Writes the output to fd, failing if it can't all be written, returns the
+  // exit code
+  auto run(std::string_view input, int fd) const
+    -> tl::expected<int, std::string>;
+
+  // The script as it runs, after --optimize if the options asked for it
+  auto commands() const -> const Commands&;
+
+private:
+  struct Script;
+  auto run_into(std::string_view input, const OutputWriter& writer) const
+    -> tl::expected<int, std::string>;
+
+  explicit Engine(std::shared_ptr<const Script> script);
+
+  std::shared_ptr<const Script> script;
+};
@@ -0,0 +1,137 @@
+#include "FileCache.h"
+
+#include <array>
+#include <fstream>
+#include <sstream>
+
+#include "Context.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+auto MappedFile::load(const std::string& name, [[maybe_unused]] bool map)
+  -> tl::expected<std::unique_ptr<MappedFile>, std::string> {
+  auto error = std::error_code();
+  auto result = std::unique_ptr<MappedFile>(new MappedFile());
+  result->mtime = std::filesystem::last_write_time(name, error);
+  if (error) {
+    return tl::make_unexpected(std::string("unable to open file with name: ")
+        + name);
+  }
+#if defined(__linux__)
+  auto fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return tl::make_unexpected(std::string("unable to open file with name: ")
+        + name);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    ::close(fd);
+    return tl::make_unexpected(std::string("unable to stat file with name: ")
+        + name);
+  }
+  result->file_size = static_cast<uintmax_t>(status.st_size);
+  if (!map) {
+    // up to the end of the file, however much it grew or shrank since fstat
+    auto block = std::array<char, 1 << 16>();
+    result->owned.reserve(result->file_size);
+    auto got = ssize_t(0);
+    while ((got = ::read(fd, block.data(), block.size())) > 0) {
+      result->owned.append(block.data(), static_cast<size_t>(got));
+    }
+    ::close(fd);
+    if (got < 0) {
+      return tl::make_unexpected(std::string("unable to read file with name: ")
+          + name);
+    }
+    result->file_size = result->owned.size();
+    return result;
+  }
+  // mmap doesn't do empty files
+  if (status.st_size > 0) {
+    auto* mapped = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      ::close(fd);
+      return tl::make_unexpected(std::string("unable to map file with name: ")
+          + name);
+    }
+    result->mapped = static_cast<const char*>(mapped);
+    result->mapped_size = status.st_size;
+  }
+  ::close(fd);
+#else
+  auto file_stream = std::ifstream(name, std::ios::binary);
+  if (!file_stream) {
+    return tl::make_unexpected(std::string("unable to open file with name: ")
+        + name);
+  }
+  std::ostringstream ss;
+  ss << file_stream.rdbuf();
+  result->owned = ss.str();
+  result->file_size = result->owned.size();
+#endif
+  return result;
+}
+
+MappedFile::~MappedFile() {
+#if defined(__linux__)
+  if (mapped) {
+    ::munmap(const_cast<char*>(mapped), mapped_size);
+  }
+#endif
+}
+
+auto MappedFile::contents() const -> std::string_view {
+  auto result = mapped
+    ? std::string_view(mapped, mapped_size)
+    : std::string_view(owned);
+  // if we don't do this there will be an extraneous nl for the majority of
+  // files processed :(
+  if (result.ends_with(nl)) {
+    result.remove_suffix(std::string_view(nl).size());
+  }
+  return result;
+}
+
+auto FileCache::open(const std::string& name)
+  -> tl::expected<size_t, std::string> {
+  if (auto slot = slots.find(name); slot != slots.end()) {
+    return slot->second;
+  }
+  auto loaded = MappedFile::load(name, policy == ReadPolicy::revalidate);
+  if (!loaded) {
+    return tl::make_unexpected(loaded.error());
+  }
+  files.push_back({name, std::move(loaded.value())});
+  slots[name] = files.size() - 1;
+  return files.size() - 1;
+}
+
+auto FileCache::get(size_t slot) -> tl::expected<std::string_view, std::string> {
+  auto& cached = files[slot];
+  if (policy == ReadPolicy::revalidate) {
+    auto error = std::error_code();
+    auto size = std::filesystem::file_size(cached.name, error);
+    auto mtime = std::filesystem::last_write_time(cached.name, error);
+    if (error || size != cached.file->size() || mtime != cached.file->modified()) {
+      auto loaded = MappedFile::load(cached.name, true);
+      if (!loaded) {
+        return tl::make_unexpected(loaded.error());
+      }
+      cached.file = std::move(loaded.value());
+    }
+  }
+  return cached.file->contents();
+}
+
+auto FileCache::loaded_bytes() const -> size_t {
+  auto bytes = size_t(0);
+  for (const auto& cached : files) {
+    bytes += static_cast<size_t>(cached.file->size());
+  }
+  return bytes;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "Options.h"
+
+// The contents of a file loaded once, memory mapped if map is set and we can,
+// otherwise read into memory. A mapping still sees writes made to the file in
+// place and raises SIGBUS on reading past a truncation, a copy never changes.
+class MappedFile {
+ public:
+  static auto load(const std::string& name, bool map)
+    -> tl::expected<std::unique_ptr<MappedFile>, std::string>;
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+  auto contents() const -> std::string_view;
+  auto size() const -> uintmax_t { return file_size; }
+  auto modified() const -> std::filesystem::file_time_type { return mtime; }
+
+ private:
+  MappedFile() = default;
+
+  // either mapped or, where mmap isn't available, owned
+  const char* mapped = nullptr;
+  size_t mapped_size = 0;
+  std::string owned;
+  uintmax_t file_size = 0;
+  std::filesystem::file_time_type mtime;
+};
+
+// Files read by read_in_file, each given a slot when it is first opened. With
+// ReadPolicy::snapshot a file is copied into memory once when it is opened and
+// that is what every later line gets, whatever happens to the file. With
+// ReadPolicy::revalidate it is mapped, its size and modification time are
+// checked on every use and it is remapped if either changed. A file truncated
+// between that check and the read can still end the run with SIGBUS, so use
+// snapshot for files something else rewrites while sim runs.
+class FileCache {
+ public:
+  FileCache(ReadPolicy policy)
+    : policy(policy),
+      files(std::vector<CachedFile>()),
+      slots(std::unordered_map<std::string, size_t>()) {}
+
+  // Loads the file now, returning its slot (the existing one if it was
+  // already opened)
+  auto open(const std::string& name) -> tl::expected<size_t, std::string>;
+  // The contents of the file minus one trailing newline (if there is one)
+  auto get(size_t slot) -> tl::expected<std::string_view, std::string>;
+  // Size of every loaded file, mapped or read into memory
+  auto loaded_bytes() const -> size_t;
+
+ private:
+  struct CachedFile {
+    std::string name;
+    std::unique_ptr<MappedFile> file;
+  };
+
+  ReadPolicy policy;
+  std::vector<CachedFile> files;
+  std::unordered_map<std::string, size_t> slots;
+};
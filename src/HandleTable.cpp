@@ -0,0 +1,70 @@
+#include "HandleTable.h"
+
+#include "Context.h"
+
+auto HandleTable::line_reader(const std::string& name)
+  -> tl::expected<size_t, std::string> {
+  for (size_t i = 0; i < line_readers.size(); i++) {
+    if (line_readers[i].name() == name) {
+      return i;
+    }
+  }
+  line_readers.emplace_back(name, nl);
+  if (auto opened = line_readers.back().open(); !opened) {
+    line_readers.pop_back();
+    return tl::make_unexpected(opened.error());
+  }
+  return line_readers.size() - 1;
+}
+
+auto HandleTable::read_bytes() const -> size_t {
+  auto bytes = read_files.loaded_bytes();
+  for (const auto& reader : line_readers) {
+    bytes += reader.buffered_bytes();
+  }
+  return bytes;
+}
+
+auto open_handles(const Commands& commands, const Program& program,
+    const Options& options)
+  -> tl::expected<std::shared_ptr<HandleTable>, std::string> {
+  auto handles = std::make_shared<HandleTable>(options);
+  for (size_t i = 0; i < program.size(); i++) {
+    if (program[i].opcode == Opcode::execute && !handles->shell
+        && options.exec_backend == ExecBackend::coprocess) {
+      auto shell = ShellCoprocess::spawn();
+      if (!shell) {
+        return tl::make_unexpected(std::string("open_handles: ")
+            + commands[i].name + std::string(": ") + shell.error());
+      }
+      handles->shell = std::move(shell.value());
+    }
+    auto kind = handle_kind(program[i].opcode);
+    if (!kind || !program[i].slot) {
+      continue;
+    }
+    const auto& name = (*commands[i].arguments)[0];
+    auto opened = tl::expected<size_t, std::string>();
+    switch (*kind) {
+      case HandleKind::read_file:
+        opened = handles->read_files.open(name);
+        break;
+      case HandleKind::line_reader:
+        opened = handles->line_reader(name);
+        break;
+      case HandleKind::output_file:
+        opened = handles->output_files.open(name);
+        break;
+    }
+    if (!opened) {
+      return tl::make_unexpected(std::string("open_handles: ")
+          + commands[i].name + std::string(": ") + opened.error());
+    }
+    // slots are handed out in order of first use, as are the tables filled
+    if (*opened != *program[i].slot) {
+      return tl::make_unexpected(std::string("open_handles: ")
+          + commands[i].name + std::string(": slot mismatch for file: ") + name);
+    }
+  }
+  return handles;
+}
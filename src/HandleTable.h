@@ -0,0 +1,72 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <tl/expected.hpp>
+#include <vector>
+
+#include "CommandTable.h"
+#include "FileCache.h"
+#include "LineReader.h"
+#include "Options.h"
+#include "OutputPool.h"
+#include "Progress.h"
+#include "ShellCoprocess.h"
+
+// Every file named by a script, opened when the script is loaded so a bad path
+// fails before the first line is read. compile_commands gives each
+// read_in_file, read_in_file_line, append_to_file and nl_append_to_file
+// command a slot in the table for its kind of file, so the commands never look
+// anything up by name while running.
+struct HandleTable {
+  // read_in_file
+  FileCache read_files;
+  // read_in_file_line
+  std::vector<LineReader> line_readers;
+  // append_to_file and nl_append_to_file, which share slots for the same file
+  OutputPool output_files;
+  // execute, only with ExecBackend::coprocess, otherwise every command popens
+  std::unique_ptr<ShellCoprocess> shell;
+  // owned by execute, only set when progress is reported
+  ProgressCounters* progress;
+  // set by quit and quit_silent, no more input is read once their cycle ends
+  std::optional<int> exit_code;
+
+  HandleTable(const Options& options)
+    : read_files(options.read_policy),
+      line_readers(std::vector<LineReader>()),
+      output_files(options),
+      shell(nullptr),
+      progress(nullptr),
+      exit_code(std::nullopt) {}
+
+  // For hackers whose commands weren't given a slot, opens the file on first
+  // use
+  auto line_reader(const std::string& name) -> tl::expected<size_t, std::string>;
+  // Memory held for open files, split into what is read and what is written
+  auto read_bytes() const -> size_t;
+  auto write_bytes() -> size_t { return output_files.buffered_bytes(); }
+};
+
+// Which of HandleTable's tables a command's slot indexes, if any
+enum class HandleKind {
+  read_file,
+  line_reader,
+  output_file,
+};
+constexpr auto handle_kind_count = size_t(3);
+
+constexpr auto handle_kind(Opcode opcode) -> std::optional<HandleKind> {
+  switch (opcode) {
+    case Opcode::read_in_file:
+      return HandleKind::read_file;
+    case Opcode::read_in_file_line:
+      return HandleKind::line_reader;
+    case Opcode::append_to_file:
+    case Opcode::nl_append_to_file:
+      return HandleKind::output_file;
+    default:
+      return std::nullopt;
+  }
+}
@@ -0,0 +1,134 @@
+#include "Latency.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+
+// 2^sub_bucket_bits buckets per power of two
+constexpr static auto sub_bucket_bits = 7;
+constexpr static auto sub_buckets = uint64_t(1) << sub_bucket_bits;
+// Values below 2 * sub_buckets each get a bucket of their own, every power of
+// two above that (up to 2^64) gets sub_buckets
+constexpr static auto bucket_count = 2 * sub_buckets
+  + (64 - sub_bucket_bits - 1) * sub_buckets;
+
+LatencyHistogram::LatencyHistogram() : counts(bucket_count, 0) {}
+
+auto LatencyHistogram::bucket(uint64_t nanoseconds) -> size_t {
+  if (nanoseconds < 2 * sub_buckets) {
+    return static_cast<size_t>(nanoseconds);
+  }
+  // shift the value down until it's in [sub_buckets, 2 * sub_buckets)
+  auto shift = static_cast<uint64_t>(std::bit_width(nanoseconds))
+    - sub_bucket_bits - 1;
+  return static_cast<size_t>(2 * sub_buckets + (shift - 1) * sub_buckets
+      + (nanoseconds >> shift) - sub_buckets);
+}
+
+auto LatencyHistogram::bucket_top(size_t bucket) -> uint64_t {
+  if (bucket < 2 * sub_buckets) {
+    return bucket;
+  }
+  auto shift = (bucket - 2 * sub_buckets) / sub_buckets + 1;
+  auto mantissa = (bucket - 2 * sub_buckets) % sub_buckets + sub_buckets;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+auto LatencyHistogram::record(uint64_t nanoseconds) -> void {
+  counts[bucket(nanoseconds)]++;
+  total++;
+  highest = std::max(highest, nanoseconds);
+}
+
+auto LatencyHistogram::count() const -> uint64_t {
+  return total;
+}
+
+auto LatencyHistogram::max() const -> uint64_t {
+  return highest;
+}
+
+auto LatencyHistogram::percentile(double fraction) const -> uint64_t {
+  if (total == 0) {
+    return 0;
+  }
+  // the rank of the value asked for, at least the first
+  auto rank = std::max(uint64_t(1), static_cast<uint64_t>(
+        fraction * static_cast<double>(total) + 0.5));
+  auto seen = uint64_t(0);
+  for (size_t i = 0; i < counts.size(); i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return std::min(bucket_top(i), highest);
+    }
+  }
+  return highest;
+}
+
+auto faster(const SlowLine& a, const SlowLine& b) -> bool {
+  return a.nanoseconds > b.nanoseconds;
+}
+
+LatencyStats::LatencyStats(size_t slow_line_limit)
+  : slow_line_limit(slow_line_limit) {}
+
+auto LatencyStats::record(const SlowLine& line) -> void {
+  histogram.record(line.nanoseconds);
+  if (slow_line_limit == 0) {
+    return;
+  }
+  if (slow_lines.size() < slow_line_limit) {
+    slow_lines.push_back(line);
+    std::push_heap(slow_lines.begin(), slow_lines.end(), faster);
+  } else if (line.nanoseconds > slow_lines.front().nanoseconds) {
+    std::pop_heap(slow_lines.begin(), slow_lines.end(), faster);
+    slow_lines.back() = line;
+    std::push_heap(slow_lines.begin(), slow_lines.end(), faster);
+  }
+}
+
+auto LatencyStats::slowest() const -> std::vector<SlowLine> {
+  auto result = slow_lines;
+  std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+    return a.nanoseconds > b.nanoseconds
+      || (a.nanoseconds == b.nanoseconds && a.cycle < b.cycle);
+  });
+  return result;
+}
+
+auto latency_report(const Commands& commands, const LatencyStats& stats)
+  -> std::string {
+  const auto& histogram = stats.histogram;
+  auto report = std::string();
+  auto line = std::array<char, 256>();
+  std::snprintf(line.data(), line.size(),
+      "latency(us) of %llu lines: p50 %.3f p99 %.3f p999 %.3f max %.3f\n",
+      static_cast<unsigned long long>(histogram.count()),
+      static_cast<double>(histogram.percentile(0.5)) / 1e3,
+      static_cast<double>(histogram.percentile(0.99)) / 1e3,
+      static_cast<double>(histogram.percentile(0.999)) / 1e3,
+      static_cast<double>(histogram.max()) / 1e3);
+  report += line.data();
+  auto slowest = stats.slowest();
+  if (slowest.empty()) {
+    return report;
+  }
+
+  std::snprintf(line.data(), line.size(), "%12s %12s %10s %12s %5s  %s\n",
+      "line", "time(us)", "bytes", "command(us)", "#", "command");
+  report += line.data();
+  for (const auto& slow : slowest) {
+    std::snprintf(line.data(), line.size(),
+        "%12llu %12.3f %10llu %12.3f %5zu  %s\n",
+        static_cast<unsigned long long>(slow.cycle),
+        static_cast<double>(slow.nanoseconds) / 1e3,
+        static_cast<unsigned long long>(slow.input_bytes),
+        static_cast<double>(slow.command_nanoseconds) / 1e3,
+        slow.command, slow.command < commands.size()
+          ? commands[slow.command].name.c_str()
+          : "");
+    report += line.data();
+  }
+  return report;
+}
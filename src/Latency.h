@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Parsing.h"
+
+// Counts of nanosecond values in log-linear buckets, the same layout as an
+// HdrHistogram with 2 significant digits: every power of two is split into
+// 128 buckets, so a value is off by at most 1/128th of itself. Fixed size
+// whatever the range, recording is a couple of shifts and an increment.
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  auto record(uint64_t nanoseconds) -> void;
+  auto count() const -> uint64_t;
+  auto max() const -> uint64_t;
+  // The smallest value at least fraction of the recorded values are at or
+  // below, rounded up to the top of its bucket (but never above max)
+  auto percentile(double fraction) const -> uint64_t;
+
+  // Exposed for the tests, every value in a bucket reports as its top
+  static auto bucket(uint64_t nanoseconds) -> size_t;
+  static auto bucket_top(size_t bucket) -> uint64_t;
+
+private:
+  std::vector<uint64_t> counts;
+  uint64_t total = 0;
+  uint64_t highest = 0;
+};
+
+// One of the slowest cycles of a run
+struct SlowLine {
+  uint64_t cycle = 0;
+  // size of the line the cycle started with
+  uint64_t input_bytes = 0;
+  uint64_t nanoseconds = 0;
+  // the command which took longest in the cycle, every time it ran summed,
+  // and how long that was
+  size_t command = 0;
+  uint64_t command_nanoseconds = 0;
+};
+
+// What run_instrumented measured of each cycle's latency. Only the slowest
+// slow_line_limit cycles are kept, in a min heap on nanoseconds so a cycle
+// that's faster than all of them costs one comparison.
+struct LatencyStats {
+  explicit LatencyStats(size_t slow_line_limit = 10);
+
+  auto record(const SlowLine& line) -> void;
+  // The kept cycles, slowest first
+  auto slowest() const -> std::vector<SlowLine>;
+
+  LatencyHistogram histogram;
+  size_t slow_line_limit;
+  std::vector<SlowLine> slow_lines;
+};
+
+// p50/p99/p999/max of the histogram, then one line per slow cycle
+auto latency_report(const Commands& commands, const LatencyStats& stats)
+  -> std::string;
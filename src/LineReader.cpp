@@ -0,0 +1,70 @@
+#include "LineReader.h"
+
+constexpr static auto line_reader_block = size_t(1) << 16;
+
+LineReader::LineReader(std::string name, std::string_view delimiter)
+  : file_name(std::move(name)),
+    delimiter(delimiter),
+    file(nullptr, &std::fclose),
+    buffer(std::string()),
+    begin(0),
+    end(0),
+    at_eof(false) {}
+
+auto LineReader::open() -> tl::expected<void, std::string> {
+  if (file) {
+    return {};
+  }
+  file.reset(std::fopen(file_name.c_str(), "rb"));
+  if (!file) {
+    return tl::make_unexpected(std::string("unable to open file with name: ")
+        + file_name);
+  }
+  // we do our own buffering
+  std::setvbuf(file.get(), nullptr, _IONBF, 0);
+  buffer.resize(line_reader_block);
+  return {};
+}
+
+auto LineReader::next_line()
+  -> tl::expected<std::optional<std::string_view>, std::string> {
+  if (!file) {
+    if (auto opened = open(); !opened) {
+      return tl::make_unexpected(opened.error());
+    }
+  }
+
+  while (true) {
+    const auto unread = std::string_view(buffer.data() + begin, end - begin);
+    auto pos = find_delimiter(unread, delimiter);
+    if (pos != std::string_view::npos) {
+      begin += pos + delimiter.size();
+      return unread.substr(0, pos);
+    }
+    if (at_eof) {
+      begin = end;
+      return unread.empty()
+        ? std::nullopt
+        : std::optional<std::string_view>(unread);
+    }
+
+    // keep the partial line and read more behind it, growing the buffer if
+    // the line is longer than it
+    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+    if (end == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    auto read = std::fread(buffer.data() + end, 1, buffer.size() - end,
+        file.get());
+    if (read == 0) {
+      if (std::ferror(file.get())) {
+        return tl::make_unexpected(std::string("unable to read file with name: ")
+            + file_name);
+      }
+      at_eof = true;
+    }
+    end += read;
+  }
+}
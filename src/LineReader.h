@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+// Position of the first delimiter at or after from. memchr does the scanning
+// (it is vectorized in any libc worth using) for the first byte of the
+// delimiter, the rest of it is then checked in place.
+inline auto find_delimiter(std::string_view text, std::string_view delimiter,
+    size_t from = 0) -> size_t {
+  while (from < text.size()) {
+    const auto* found = static_cast<const char*>(std::memchr(text.data() + from,
+          delimiter[0], text.size() - from));
+    if (!found) {
+      return std::string_view::npos;
+    }
+    const auto pos = static_cast<size_t>(found - text.data());
+    if (text.substr(pos, delimiter.size()) == delimiter) {
+      return pos;
+    }
+    from = pos + 1;
+  }
+  return std::string_view::npos;
+}
+
+// Reads a file one delimited line at a time through a large buffer which is
+// filled with plain block reads, lines are handed out as views into it.
+class LineReader {
+ public:
+  LineReader(std::string name, std::string_view delimiter);
+
+  auto name() const -> const std::string& { return file_name; }
+  auto is_open() const -> bool { return file != nullptr; }
+  auto open() -> tl::expected<void, std::string>;
+  // The next line without its delimiter, or nullopt once the file is done. Like
+  // std::getline the last line doesn't need a delimiter. The view is good until
+  // the next call.
+  auto next_line() -> tl::expected<std::optional<std::string_view>, std::string>;
+  // Memory held by the block buffer
+  auto buffered_bytes() const -> size_t { return buffer.capacity(); }
+
+ private:
+  std::string file_name;
+  std::string_view delimiter;
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file;
+  std::string buffer;
+  size_t begin;
+  size_t end;
+  bool at_eof;
+};
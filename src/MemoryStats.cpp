@@ -0,0 +1,79 @@
+#include "MemoryStats.h"
+
+#include <atomic>
+
+namespace {
+  std::atomic<bool> counting = false;
+  std::atomic<uint64_t> allocations = 0;
+  std::atomic<uint64_t> deallocations = 0;
+  std::atomic<uint64_t> allocated_bytes = 0;
+  std::atomic<uint64_t> live_bytes = 0;
+  std::atomic<uint64_t> peak_live_bytes = 0;
+}
+
+auto count_allocation(uint64_t bytes) -> void {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  auto live = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  auto peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live,
+        std::memory_order_relaxed)) { }
+}
+
+auto count_deallocation(uint64_t bytes) -> void {
+  deallocations.fetch_add(1, std::memory_order_relaxed);
+  live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+auto enable_allocation_counting() -> void {
+  counting = true;
+}
+
+auto allocation_counts() -> AllocationCounts {
+  return AllocationCounts{
+    counting.load(),
+    allocations.load(std::memory_order_relaxed),
+    deallocations.load(std::memory_order_relaxed),
+    allocated_bytes.load(std::memory_order_relaxed),
+    live_bytes.load(std::memory_order_relaxed),
+    peak_live_bytes.load(std::memory_order_relaxed),
+  };
+}
+
+auto gauge_line(const std::string& name, const MemoryGauge& gauge)
+  -> std::string {
+  return name + ": " + std::to_string(gauge.current) + " bytes, peak "
+    + std::to_string(gauge.peak) + " bytes\n";
+}
+
+auto memory_report(const MemoryStats& stats) -> std::string {
+  auto report = gauge_line("pattern space", stats.pattern_space)
+    + gauge_line("hold space", stats.hold_space)
+    + gauge_line("result", stats.result)
+    + gauge_line("output buffers", stats.output_buffers)
+    + gauge_line("input files", stats.input_files);
+  const auto& counts = stats.allocations;
+  if (!counts.counted) {
+    return report + "heap: not counted\n";
+  }
+  return report + "heap: " + std::to_string(counts.allocations)
+    + " allocations, " + std::to_string(counts.deallocations)
+    + " deallocations, " + std::to_string(counts.allocated_bytes)
+    + " bytes allocated, " + std::to_string(counts.live_bytes)
+    + " bytes live, peak " + std::to_string(counts.peak_live_bytes)
+    + " bytes\n";
+}
+
+auto memory_sample(uint64_t cycle, const MemoryStats& stats) -> std::string {
+  auto sample = "memory: cycle " + std::to_string(cycle)
+    + " pattern " + std::to_string(stats.pattern_space.current)
+    + " hold " + std::to_string(stats.hold_space.current)
+    + " result " + std::to_string(stats.result.current)
+    + " output " + std::to_string(stats.output_buffers.current)
+    + " input " + std::to_string(stats.input_files.current);
+  if (stats.allocations.counted) {
+    sample += " heap " + std::to_string(stats.allocations.live_bytes)
+      + " allocations " + std::to_string(stats.allocations.allocations);
+  }
+  return sample + "\n";
+}
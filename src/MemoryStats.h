@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+// Current and highest value seen of one kind of memory
+struct MemoryGauge {
+  uint64_t current = 0;
+  uint64_t peak = 0;
+
+  auto set(uint64_t bytes) -> void {
+    current = bytes;
+    peak = std::max(peak, bytes);
+  }
+};
+
+// Heap traffic as seen by the counting operator new in AllocationCounter.cpp,
+// which only the sim binary links in. Everything is 0 (and counted false)
+// without it.
+struct AllocationCounts {
+  bool counted = false;
+  uint64_t allocations = 0;
+  uint64_t deallocations = 0;
+  uint64_t allocated_bytes = 0;
+  uint64_t live_bytes = 0;
+  uint64_t peak_live_bytes = 0;
+};
+auto allocation_counts() -> AllocationCounts;
+
+// Called by the counting operator new and delete
+auto count_allocation(uint64_t bytes) -> void;
+auto count_deallocation(uint64_t bytes) -> void;
+auto enable_allocation_counting() -> void;
+
+// What run_instrumented measured of a run. The pattern and hold space are
+// measured after every command (so an N loop which shrinks back with D still
+// shows its peak), everything else once a line.
+struct MemoryStats {
+  // capacity of operations_stream and static_stream
+  MemoryGauge pattern_space;
+  MemoryGauge hold_space;
+  // the output built up in Context::result
+  MemoryGauge result;
+  // buffered by the output files, see OutputPool
+  MemoryGauge output_buffers;
+  // loaded by read_in_file and buffered by read_in_file_line
+  MemoryGauge input_files;
+  AllocationCounts allocations;
+};
+
+// One line per gauge for the end of a run
+auto memory_report(const MemoryStats& stats) -> std::string;
+// A single line, for sampling during the run
+auto memory_sample(uint64_t cycle, const MemoryStats& stats) -> std::string;
@@ -0,0 +1,240 @@
+#include "Optimizer.h"
+
+#include <set>
+
+#include "CommandTable.h"
+#include "Context.h"
+
+auto has_opcode(const Command& command, Opcode opcode) -> bool {
+  return lookup_opcode(command.name) == opcode;
+}
+
+auto has_one_argument(const Command& command) -> bool {
+  return command.arguments && command.arguments->size() == 1;
+}
+
+// Mirrors find_label_index in Context.cpp, the first label with the name wins
+auto resolve_label(const Commands& commands,
+    const std::string& label) -> std::optional<size_t> {
+  for (size_t i = 0; i < commands.size(); i++) {
+    if (has_opcode(commands[i], Opcode::verify_label)
+        && has_one_argument(commands[i])
+        && (*commands[i].arguments)[0] == label) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+// A label which will not error when execution falls through it
+auto is_label(const Command& command) -> bool {
+  return has_opcode(command, Opcode::verify_label)
+    && has_one_argument(command) && !command.address;
+}
+
+auto is_jump(const Command& command) -> bool {
+  return (has_opcode(command, Opcode::branch)
+      || has_opcode(command, Opcode::branch_true)
+      || has_opcode(command, Opcode::branch_false))
+    && has_one_argument(command);
+}
+
+auto is_unconditional_branch(const Command& command) -> bool {
+  return has_opcode(command, Opcode::branch) && has_one_argument(command)
+    && !command.address;
+}
+
+auto jump_targets(const Commands& commands) -> std::set<size_t> {
+  auto targets = std::set<size_t>();
+  for (const auto& command : commands) {
+    if (is_jump(command)) {
+      if (auto target = resolve_label(commands, (*command.arguments)[0])) {
+        targets.insert(*target);
+      }
+    }
+  }
+  return targets;
+}
+
+// Execution resumes after the label which is jumped to, so skip over any
+// labels which follow it
+auto after_labels(const Commands& commands, size_t index) -> size_t {
+  index++;
+  while (index < commands.size() && is_label(commands[index])) {
+    index++;
+  }
+  return index;
+}
+
+auto thread_jumps(Commands& commands) -> bool {
+  auto changed = false;
+  for (auto& command : commands) {
+    if (!is_jump(command)) {
+      continue;
+    }
+    auto& label = (*command.arguments)[0];
+    auto visited = std::set<size_t>();
+    auto target = resolve_label(commands, label);
+    while (target && visited.insert(*target).second) {
+      auto next = after_labels(commands, *target);
+      if (next >= commands.size() || !is_unconditional_branch(commands[next])) {
+        break;
+      }
+      const auto& next_label = (*commands[next].arguments)[0];
+      auto next_target = resolve_label(commands, next_label);
+      // a conditional branch to a missing label ends the cycle regardless of
+      // the condition, so only the unconditional branch can take that over
+      if (!next_target && !has_opcode(command, Opcode::branch)) {
+        break;
+      }
+      if (next_label != label) {
+        label = next_label;
+        changed = true;
+      }
+      target = next_target;
+    }
+  }
+  return changed;
+}
+
+auto collapse_label_chains(Commands& commands) -> bool {
+  auto changed = false;
+  for (auto& command : commands) {
+    if (!is_jump(command)) {
+      continue;
+    }
+    auto& label = (*command.arguments)[0];
+    auto target = resolve_label(commands, label);
+    if (!target) {
+      continue;
+    }
+    auto first = *target;
+    while (first > 0 && is_label(commands[first - 1])
+        && resolve_label(commands, (*commands[first - 1].arguments)[0]) == first - 1) {
+      first--;
+    }
+    if (first != *target) {
+      label = (*commands[first].arguments)[0];
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+auto remove_noop_jumps(Commands& commands) -> bool {
+  auto changed = false;
+  for (size_t i = 0; i < commands.size();) {
+    auto target = is_jump(commands[i])
+      ? resolve_label(commands, (*commands[i].arguments)[0])
+      : std::nullopt;
+    auto lands_next = target && *target > i;
+    for (size_t j = i + 1; lands_next && j <= *target; j++) {
+      lands_next = is_label(commands[j]);
+    }
+    if (lands_next) {
+      commands.erase(commands.begin() + i);
+      changed = true;
+    } else {
+      i++;
+    }
+  }
+  return changed;
+}
+
+auto remove_unreachable(Commands& commands) -> bool {
+  auto changed = false;
+  auto targets = jump_targets(commands);
+  auto reachable = true;
+  auto result = Commands();
+  for (size_t i = 0; i < commands.size(); i++) {
+    if (targets.contains(i)) {
+      reachable = true;
+    }
+    if (!reachable) {
+      changed = true;
+      continue;
+    }
+    const auto& command = commands[i];
+    if (is_label(command) && !targets.contains(i)) {
+      changed = true;
+      continue;
+    }
+    if (is_unconditional_branch(command)
+        || (has_opcode(command, Opcode::delete_) && !command.address)) {
+      reachable = false;
+    }
+    result.push_back(command);
+  }
+  commands = std::move(result);
+  return changed;
+}
+
+auto merge_adjacent(Commands& commands) -> bool {
+  auto changed = false;
+  for (size_t i = 0; i + 1 < commands.size();) {
+    auto& first = commands[i];
+    const auto& second = commands[i + 1];
+    auto same_shape = has_one_argument(first) && has_one_argument(second)
+      && first.address == second.address;
+    if (same_shape && has_opcode(first, Opcode::append)
+        && has_opcode(second, Opcode::append)) {
+      (*first.arguments)[0] += nl + (*second.arguments)[0];
+    } else if (same_shape && has_opcode(first, Opcode::insert)
+        && has_opcode(second, Opcode::insert)) {
+      (*first.arguments)[0] = (*second.arguments)[0] + nl
+        + (*first.arguments)[0];
+    } else {
+      i++;
+      continue;
+    }
+    commands.erase(commands.begin() + i + 1);
+    changed = true;
+  }
+  return changed;
+}
+
+// Commands which set the pattern space without reading it
+auto overwrites_operations(const Command& command) -> bool {
+  return (has_opcode(command, Opcode::change) && has_one_argument(command))
+    || (has_opcode(command, Opcode::zap) && !command.arguments)
+    || (has_opcode(command, Opcode::replace_operation) && !command.arguments);
+}
+
+auto remove_dead_writes(Commands& commands) -> bool {
+  auto changed = false;
+  for (size_t i = 0; i + 1 < commands.size();) {
+    const auto& first = commands[i];
+    const auto& second = commands[i + 1];
+    if (overwrites_operations(first) && overwrites_operations(second)
+        && (!second.address || second.address == first.address)) {
+      commands.erase(commands.begin() + i);
+      changed = true;
+    } else {
+      i++;
+    }
+  }
+  return changed;
+}
+
+auto optimize_commands(const Commands& commands) -> Commands {
+  for (const auto& command : commands) {
+    auto opcode = lookup_opcode(command.name);
+    if (!opcode || *opcode == Opcode::delete_restart) {
+      return commands;
+    }
+  }
+
+  auto result = commands;
+  auto changed = true;
+  // threading and chain collapsing can in theory chase each other around a
+  // loop of labels, so bound the number of rounds
+  for (size_t round = 0; changed && round <= commands.size(); round++) {
+    changed = thread_jumps(result);
+    changed |= collapse_label_chains(result);
+    changed |= remove_noop_jumps(result);
+    changed |= remove_unreachable(result);
+    changed |= merge_adjacent(result);
+    changed |= remove_dead_writes(result);
+  }
+  return result;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Parsing.h"
+
+// Peephole passes over a parsed script, run until nothing changes:
+//   - jumps to a label which is immediately followed by an unconditional branch
+//     are threaded to that branch's label, and jumps to labels which follow
+//     another label are pointed at the first label of the chain.
+//   - branches which would land on the next command are removed.
+//   - commands after an unaddressed branch or delete are removed up to the next
+//     label which something branches to, unreferenced labels are removed.
+//   - adjacent append (or insert) commands with the same address are merged
+//     into one command building the whole string.
+//   - change, zap and replace_operation are dropped when the next command
+//     overwrites the pattern space without reading it under the same address.
+// Scripts containing delete_restart or commands registered at runtime are
+// returned unchanged as they can jump to places these passes can't see.
+auto optimize_commands(const Commands& commands) -> Commands;
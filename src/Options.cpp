@@ -0,0 +1,194 @@
+#include "Options.h"
+
+#include <charconv>
+#include <vector>
+
+static constexpr auto usage = "usage: sim [--optimize] [--dump-program] "
+  "[--stream-json] [--serve=SOCKET] [--workers=N] "
+  "[--threads=N] [--batch] [--flush=end|write] [--write-behind] "
+  "[--output-buffer=BYTES] [--read-policy=revalidate|snapshot] "
+  "[--exec=popen|shell] [--exec-jobs=N] [--profile[=FILE]] [--counters] "
+  "[--trace=FILE] [--trace-sample=N] [--trace-threshold=MICROSECONDS] "
+  "[--memory-stats] [--memory-sample=N] [--latency[=N]] "
+  "[--progress[=SECONDS]] [--progress-file=FILE] [--script-cache=DIR] "
+  "input json_script";
+
+// Value of an option of the form --name=value
+auto option_value(const std::string& argument, const std::string& name)
+  -> std::optional<std::string> {
+  auto prefix = name + "=";
+  if (!argument.starts_with(prefix)) {
+    return std::nullopt;
+  }
+  return argument.substr(prefix.size());
+}
+
+// from_chars, unlike stoull, takes no sign or whitespace, so "-1" is an error
+// rather than 2^64 - 1
+auto parse_count(const std::string& name, const std::string& value)
+  -> tl::expected<size_t, std::string> {
+  auto count = size_t(0);
+  auto [end, error] = std::from_chars(value.data(),
+      value.data() + value.size(), count);
+  if (!value.empty() && error == std::errc()
+      && end == value.data() + value.size()) {
+    return count;
+  }
+  return tl::make_unexpected(std::string("parse_arguments: ") + name
+      + std::string(" expects a non negative number, got: ") + value);
+}
+
+auto parse_arguments(int argc, char* argv[])
+  -> tl::expected<Arguments, std::string> {
+  auto arguments = Arguments();
+  // unlike execute, on the command line make use of every core by default
+  arguments.options.threads = 0;
+  auto positional = std::vector<std::string>();
+  for (int i = 1; i < argc; i++) {
+    auto argument = std::string(argv[i]);
+    if (argument == "--optimize") {
+      arguments.options.optimize = true;
+    } else if (auto value = option_value(argument, "--serve")) {
+      arguments.serve_socket = *value;
+    } else if (auto value = option_value(argument, "--workers")) {
+      auto workers = parse_count("--workers", *value);
+      if (!workers) {
+        return tl::make_unexpected(workers.error());
+      }
+      arguments.daemon_workers = *workers;
+    } else if (argument == "--stream-json") {
+      arguments.stream_json = true;
+    } else if (argument == "--dump-program") {
+      arguments.dump_program = true;
+    } else if (argument == "--batch") {
+      arguments.options.batch = true;
+    } else if (auto value = option_value(argument, "--threads")) {
+      auto threads = parse_count("--threads", *value);
+      if (!threads) {
+        return tl::make_unexpected(threads.error());
+      }
+      arguments.options.threads = *threads;
+    } else if (auto value = option_value(argument, "--flush")) {
+      if (*value == "end") {
+        arguments.options.flush_policy = FlushPolicy::end_of_run;
+      } else if (*value == "write") {
+        arguments.options.flush_policy = FlushPolicy::every_write;
+      } else {
+        return tl::make_unexpected(std::string("parse_arguments: --flush "
+              "expects end or write, got: ") + *value);
+      }
+    } else if (argument == "--write-behind") {
+      arguments.options.write_behind = true;
+    } else if (auto value = option_value(argument, "--output-buffer")) {
+      auto bytes = parse_count("--output-buffer", *value);
+      if (!bytes) {
+        return tl::make_unexpected(bytes.error());
+      }
+      if (*bytes > max_output_buffer_bytes) {
+        return tl::make_unexpected(std::string("parse_arguments: "
+              "--output-buffer is larger than 1GiB: ") + *value);
+      }
+      arguments.options.output_buffer_bytes = *bytes;
+    } else if (auto value = option_value(argument, "--read-policy")) {
+      if (*value == "revalidate") {
+        arguments.options.read_policy = ReadPolicy::revalidate;
+      } else if (*value == "snapshot") {
+        arguments.options.read_policy = ReadPolicy::snapshot;
+      } else {
+        return tl::make_unexpected(std::string("parse_arguments: --read-policy "
+              "expects revalidate or snapshot, got: ") + *value);
+      }
+    } else if (auto value = option_value(argument, "--exec")) {
+      if (*value == "popen") {
+        arguments.options.exec_backend = ExecBackend::popen;
+      } else if (*value == "shell") {
+        arguments.options.exec_backend = ExecBackend::coprocess;
+      } else {
+        return tl::make_unexpected(std::string("parse_arguments: --exec "
+              "expects popen or shell, got: ") + *value);
+      }
+    } else if (auto value = option_value(argument, "--exec-jobs")) {
+      auto jobs = parse_count("--exec-jobs", *value);
+      if (!jobs) {
+        return tl::make_unexpected(jobs.error());
+      }
+      arguments.options.exec_jobs = *jobs;
+    } else if (argument == "--counters") {
+      arguments.options.profile_counters = true;
+      if (arguments.options.profile == ProfileOutput::none) {
+        arguments.options.profile = ProfileOutput::report;
+      }
+    } else if (argument == "--profile") {
+      arguments.options.profile = ProfileOutput::report;
+    } else if (auto value = option_value(argument, "--profile")) {
+      arguments.options.profile = ProfileOutput::json;
+      arguments.options.profile_file = *value;
+    } else if (auto value = option_value(argument, "--trace")) {
+      arguments.options.trace_file = *value;
+    } else if (auto value = option_value(argument, "--trace-sample")) {
+      auto every = parse_count("--trace-sample", *value);
+      if (!every) {
+        return tl::make_unexpected(every.error());
+      }
+      arguments.options.trace_sample_every = *every;
+    } else if (auto value = option_value(argument, "--trace-threshold")) {
+      auto micros = parse_count("--trace-threshold", *value);
+      if (!micros) {
+        return tl::make_unexpected(micros.error());
+      }
+      // held as nanoseconds, which have to fit an int64
+      if (*micros > std::chrono::nanoseconds::max().count() / 1000) {
+        return tl::make_unexpected(std::string("parse_arguments: "
+              "--trace-threshold is too large: ") + *value);
+      }
+      arguments.options.trace_threshold = std::chrono::microseconds(*micros);
+    } else if (argument == "--memory-stats") {
+      arguments.options.memory_stats = true;
+    } else if (auto value = option_value(argument, "--memory-sample")) {
+      auto every = parse_count("--memory-sample", *value);
+      if (!every) {
+        return tl::make_unexpected(every.error());
+      }
+      arguments.options.memory_sample_every = *every;
+    } else if (auto value = option_value(argument, "--script-cache")) {
+      arguments.options.script_cache_dir = *value;
+    } else if (argument == "--latency") {
+      arguments.options.latency = true;
+    } else if (auto value = option_value(argument, "--latency")) {
+      auto count = parse_count("--latency", *value);
+      if (!count) {
+        return tl::make_unexpected(count.error());
+      }
+      arguments.options.latency = true;
+      arguments.options.slow_lines = *count;
+    } else if (argument == "--progress") {
+      arguments.options.progress = true;
+    } else if (auto value = option_value(argument, "--progress")) {
+      auto seconds = parse_count("--progress", *value);
+      if (!seconds) {
+        return tl::make_unexpected(seconds.error());
+      }
+      arguments.options.progress = true;
+      arguments.options.progress_interval = std::chrono::seconds(*seconds);
+    } else if (auto value = option_value(argument, "--progress-file")) {
+      arguments.options.progress = true;
+      arguments.options.progress_file = *value;
+    } else if (argument.starts_with("--")) {
+      return tl::make_unexpected(std::string("parse_arguments: unknown option: ")
+          + argument + std::string("\n") + usage);
+    } else {
+      positional.push_back(argument);
+    }
+  }
+
+  if (positional.size() == 2) {
+    arguments.input_file = positional[0];
+    arguments.command_file = positional[1];
+  } else if (positional.size() == 1 && arguments.dump_program) {
+    arguments.command_file = positional[0];
+  } else if (!positional.empty() || !arguments.serve_socket) {
+    return tl::make_unexpected(std::string("parse_arguments: sim requires two "
+          "arguments: input, json script\n") + usage);
+  }
+  return arguments;
+}
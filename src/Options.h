@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <tl/expected.hpp>
+
+// When the files written by append_to_file/nl_append_to_file are pushed to
+// disk, besides whenever their buffer fills up
+enum class FlushPolicy {
+  end_of_run,
+  every_write,
+};
+
+// Whether read_in_file checks if its file changed on disk before every use
+enum class ReadPolicy {
+  revalidate,
+  snapshot,
+};
+
+// How execute runs the pattern space as a shell command
+enum class ExecBackend {
+  // popen, a new shell for every command
+  popen,
+  // one ShellCoprocess for the whole run
+  coprocess,
+};
+
+// Where execute puts the per command profile of a run, see Profiler.h
+enum class ProfileOutput {
+  none,
+  // a table on stderr, slowest command first
+  report,
+  // json into Options::profile_file
+  json,
+};
+
+// The largest Options::output_buffer_bytes, parse_arguments refuses more and
+// OutputPool caps anything set directly
+constexpr auto max_output_buffer_bytes = size_t(1) << 30;
+
+// Knobs for a single run of sim, everything defaults to the plain behavior of
+// execute so that tests and hackers can ignore this entirely.
+struct Options {
+  // run optimize_commands over the script before it is compiled
+  bool optimize = false;
+  // worker threads for scripts which only look at the current line, 0 picks
+  // one per core and 1 always runs serially
+  size_t threads = 1;
+  // run line local scripts through run_batched instead of run_script
+  bool batch = false;
+  // inputs smaller than this per worker are not worth splitting
+  size_t parallel_min_bytes = size_t(1) << 20;
+  // user space buffer per output file
+  size_t output_buffer_bytes = size_t(1) << 20;
+  FlushPolicy flush_policy = FlushPolicy::end_of_run;
+  // write full output buffers from a background thread
+  bool write_behind = false;
+  ReadPolicy read_policy = ReadPolicy::revalidate;
+  ExecBackend exec_backend = ExecBackend::popen;
+  // shell commands run at once for scripts where execute is the only thing
+  // which isn't line local, 0 picks one per core and 1 runs them in order
+  size_t exec_jobs = 1;
+  // profiling always runs the script serially through run_instrumented
+  ProfileOutput profile = ProfileOutput::none;
+  std::string profile_file;
+  // add cycles, instructions, branch and cache misses to the profile, falls
+  // back to timers alone when perf events can't be opened
+  bool profile_counters = false;
+  // write a Chrome trace of the run here (serially too), empty for none
+  std::string trace_file;
+  // every how many cycles one is traced, slower cycles are always traced
+  size_t trace_sample_every = 1000;
+  std::chrono::nanoseconds trace_threshold = std::chrono::milliseconds(1);
+  // print a MemoryStats report to stderr at the end of the run (serially)
+  bool memory_stats = false;
+  // and a sample of it every this many cycles, 0 for never
+  size_t memory_sample_every = 0;
+  // keep compiled scripts here and load them from here instead of parsing
+  // the json again, see ScriptCache.h. Empty for no cache.
+  std::string script_cache_dir;
+  // time every cycle, print the p50/p99/p999/max and the slow_lines slowest
+  // cycles at the end, runs the script serially
+  bool latency = false;
+  size_t slow_lines = 10;
+  // report progress from a background thread every progress_interval (0 for
+  // only on SIGUSR1), to stderr or into progress_file
+  bool progress = false;
+  std::chrono::milliseconds progress_interval = std::chrono::seconds(10);
+  std::string progress_file;
+};
+
+// What main gets out of the command line
+struct Arguments {
+  Options options;
+  std::optional<std::string> input_file;
+  std::string command_file;
+  // print the (optimized if requested) script as json instead of running it
+  bool dump_program = false;
+  // read the script with parse_json_stream rather than parse_json
+  bool stream_json = false;
+  // run as a Daemon listening here instead, with daemon_workers workers (0
+  // for one per core)
+  std::optional<std::string> serve_socket;
+  size_t daemon_workers = 0;
+};
+
+auto parse_arguments(int argc, char* argv[])
+  -> tl::expected<Arguments, std::string>;
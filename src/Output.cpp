@@ -0,0 +1,92 @@
+#include "Output.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <ctime>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+auto output_pieces(std::string_view input, std::string_view result,
+    const OutputSegments& segments) -> std::vector<std::string_view> {
+  auto pieces = std::vector<std::string_view>();
+  pieces.reserve(2 * segments.size() + 1);
+  auto result_position = size_t(0);
+  for (const auto& segment : segments) {
+    if (segment.result_offset > result_position) {
+      pieces.push_back(result.substr(result_position,
+            segment.result_offset - result_position));
+      result_position = segment.result_offset;
+    }
+    pieces.push_back(input.substr(segment.input_offset, segment.size));
+  }
+  if (result_position < result.size()) {
+    pieces.push_back(result.substr(result_position));
+  }
+  return pieces;
+}
+
+auto fd_writer(int fd) -> OutputWriter {
+  return [fd](std::span<const std::string_view> pieces) {
+    return write_all(fd, pieces);
+  };
+}
+
+auto write_all(int fd, std::string_view data) -> bool {
+  return write_all(fd, std::span<const std::string_view>(&data, 1));
+}
+
+#if !defined(__linux__)
+auto write_all(int, std::span<const std::string_view>) -> bool {
+  return false;
+}
+#else
+// The reader may have died, in which case writing to it raises SIGPIPE, block
+// it for this thread and swallow it so we get EPIPE instead of being killed
+auto write_all(int fd, std::span<const std::string_view> pieces) -> bool {
+  sigset_t pipe_signal;
+  sigset_t previous;
+  sigemptyset(&pipe_signal);
+  sigaddset(&pipe_signal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_signal, &previous);
+
+  auto vectors = std::vector<iovec>();
+  vectors.reserve(std::min(pieces.size(), size_t(IOV_MAX)));
+  auto written = true;
+  // the next piece to write and how much of it is already written
+  auto next = size_t(0);
+  auto skip = size_t(0);
+  while (next < pieces.size()) {
+    vectors.clear();
+    for (auto i = next; i < pieces.size() && vectors.size() < IOV_MAX; i++) {
+      auto piece = pieces[i].substr(i == next ? skip : 0);
+      vectors.push_back({const_cast<char*>(piece.data()), piece.size()});
+    }
+    auto count = ::writev(fd, vectors.data(), static_cast<int>(vectors.size()));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count < 0) {
+      written = false;
+      break;
+    }
+    auto left = static_cast<size_t>(count);
+    while (next < pieces.size() && left >= pieces[next].size() - skip) {
+      left -= pieces[next].size() - skip;
+      next++;
+      skip = 0;
+    }
+    skip += left;
+  }
+
+  if (!written) {
+    auto no_wait = timespec{0, 0};
+    while (sigtimedwait(&pipe_signal, nullptr, &no_wait) > 0) { }
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+  return written;
+}
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A run of lines which came out of the script byte for byte as they went in,
+// written straight from the input rather than copied into Context::result.
+// It goes before whatever result_offset bytes of the result follow it.
+struct OutputSegment {
+  size_t result_offset;
+  size_t input_offset;
+  size_t size;
+};
+using OutputSegments = std::vector<OutputSegment>;
+
+// The output of a run in order, alternating pieces of result and input. Empty
+// pieces are left out.
+auto output_pieces(std::string_view input, std::string_view result,
+    const OutputSegments& segments) -> std::vector<std::string_view>;
+
+// Where a run's output goes, pieces are only valid for the call
+using OutputWriter = std::function<bool(std::span<const std::string_view>)>;
+
+// Writes pieces to fd with writev, as many at once as the kernel takes
+auto fd_writer(int fd) -> OutputWriter;
+
+// Writes all of data to fd, retrying short writes. False if fd is closed or
+// broken, with the SIGPIPE that would otherwise kill us swallowed.
+auto write_all(int fd, std::string_view data) -> bool;
+auto write_all(int fd, std::span<const std::string_view> pieces) -> bool;
@@ -0,0 +1,173 @@
+#include "OutputPool.h"
+
+#include <algorithm>
+
+// how many full buffers may queue up for the write behind thread before the
+// script has to wait for it
+constexpr static auto max_pending_buffers = size_t(8);
+
+OutputPool::OutputPool(const Options& options)
+  : buffer_bytes(std::clamp(options.output_buffer_bytes, size_t(1),
+        max_output_buffer_bytes)),
+    flush_policy(options.flush_policy),
+    write_behind(options.write_behind),
+    slots(std::unordered_map<std::string, size_t>()),
+    files(std::vector<OutputFile>()),
+    pending(std::deque<std::pair<std::FILE*, std::string>>()),
+    writing(false),
+    stopping(false),
+    background_error(std::string()) {}
+
+OutputPool::~OutputPool() {
+  // nowhere to report errors to at this point, execute flushes explicitly
+  (void)(flush());
+  if (writer.joinable()) {
+    {
+      auto lock = std::lock_guard(mutex);
+      stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+  }
+}
+
+auto OutputPool::open(const std::string& name)
+  -> tl::expected<size_t, std::string> {
+  if (auto slot = slots.find(name); slot != slots.end()) {
+    return slot->second;
+  }
+  auto* file = std::fopen(name.c_str(), "ab");
+  if (!file) {
+    return tl::make_unexpected(std::string("unable to open file with name: ")
+        + name);
+  }
+  // we do our own buffering
+  std::setvbuf(file, nullptr, _IONBF, 0);
+  files.emplace_back(name, file);
+  try {
+    files.back().buffer.reserve(buffer_bytes);
+  } catch (const std::exception&) {
+    files.pop_back();
+    return tl::make_unexpected(std::string("unable to allocate the output "
+          "buffer of ") + std::to_string(buffer_bytes) + " bytes for file with "
+        "name: " + name);
+  }
+  slots[name] = files.size() - 1;
+  return files.size() - 1;
+}
+
+auto OutputPool::write(size_t slot, std::string_view data) -> ResultVoid {
+  auto& file = files[slot];
+  if (file.buffer.size() + data.size() > buffer_bytes && !file.buffer.empty()) {
+    if (auto handed_off = hand_off(file); !handed_off) {
+      return handed_off;
+    }
+  }
+  file.buffer.append(data);
+  if (flush_policy == FlushPolicy::every_write
+      || file.buffer.size() >= buffer_bytes) {
+    return hand_off(file);
+  }
+  return {};
+}
+
+auto OutputPool::write(const std::string& name, std::string_view data)
+  -> ResultVoid {
+  auto slot = open(name);
+  if (!slot) {
+    return tl::make_unexpected(slot.error());
+  }
+  return write(*slot, data);
+}
+
+auto OutputPool::hand_off(OutputFile& file) -> ResultVoid {
+  if (file.buffer.empty()) {
+    return {};
+  }
+  if (!write_behind) {
+    auto written = std::fwrite(file.buffer.data(), 1, file.buffer.size(),
+        file.file.get());
+    if (written != file.buffer.size()) {
+      return tl::make_unexpected(std::string("unable to write to file with "
+            "name: ") + file.name);
+    }
+    file.buffer.clear();
+    return {};
+  }
+
+  if (!writer.joinable()) {
+    writer = std::thread(&OutputPool::write_behind_loop, this);
+  }
+  auto buffer = std::string();
+  try {
+    buffer.reserve(buffer_bytes);
+  } catch (const std::exception&) {
+    return tl::make_unexpected(std::string("unable to allocate the output "
+          "buffer of ") + std::to_string(buffer_bytes) + " bytes for file with "
+        "name: " + file.name);
+  }
+  std::swap(buffer, file.buffer);
+  {
+    auto lock = std::unique_lock(mutex);
+    changed.wait(lock, [this] { return pending.size() < max_pending_buffers; });
+    pending.emplace_back(file.file.get(), std::move(buffer));
+  }
+  changed.notify_all();
+  return {};
+}
+
+auto OutputPool::write_behind_loop() -> void {
+  auto lock = std::unique_lock(mutex);
+  while (true) {
+    changed.wait(lock, [this] { return stopping || !pending.empty(); });
+    if (pending.empty()) {
+      return;
+    }
+    auto [file, buffer] = std::move(pending.front());
+    pending.pop_front();
+    writing = true;
+    lock.unlock();
+    changed.notify_all();
+    auto written = std::fwrite(buffer.data(), 1, buffer.size(), file);
+    lock.lock();
+    writing = false;
+    if (written != buffer.size() && background_error.empty()) {
+      background_error = "unable to complete a background write";
+    }
+    changed.notify_all();
+  }
+}
+
+auto OutputPool::flush() -> ResultVoid {
+  for (auto& file : files) {
+    if (auto handed_off = hand_off(file); !handed_off) {
+      return handed_off;
+    }
+  }
+  if (writer.joinable()) {
+    auto lock = std::unique_lock(mutex);
+    changed.wait(lock, [this] { return pending.empty() && !writing; });
+    if (!background_error.empty()) {
+      return tl::make_unexpected(std::exchange(background_error, std::string()));
+    }
+  }
+  for (auto& file : files) {
+    if (std::fflush(file.file.get()) != 0) {
+      return tl::make_unexpected(std::string("unable to flush file with name: ")
+          + file.name);
+    }
+  }
+  return {};
+}
+
+auto OutputPool::buffered_bytes() -> size_t {
+  auto bytes = size_t(0);
+  for (const auto& file : files) {
+    bytes += file.buffer.capacity();
+  }
+  auto lock = std::lock_guard(mutex);
+  for (const auto& [_, buffer] : pending) {
+    bytes += buffer.capacity();
+  }
+  return bytes;
+}
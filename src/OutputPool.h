@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tl/expected.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "Options.h"
+
+using ResultVoid = tl::expected<void, std::string>;
+
+// A file opened for appending by append_to_file/nl_append_to_file, the bytes
+// are kept in buffer until it fills or the pool is flushed.
+struct OutputFile {
+  std::string name;
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file;
+  std::string buffer;
+
+  OutputFile(std::string name, std::FILE* file)
+    : name(std::move(name)),
+      file(file, &std::fclose),
+      buffer(std::string()) {}
+};
+
+// Every file written to during a run is opened once, on first use, and stays
+// open until the pool is destroyed. With options.write_behind the actual
+// writes happen on a background thread so the script only ever copies into a
+// buffer.
+class OutputPool {
+ public:
+  OutputPool(const Options& options);
+  ~OutputPool();
+  OutputPool(const OutputPool&) = delete;
+  auto operator=(const OutputPool&) -> OutputPool& = delete;
+
+  // Returns the slot of the file, opening it in append mode if needed
+  auto open(const std::string& name) -> tl::expected<size_t, std::string>;
+  auto write(size_t slot, std::string_view data) -> ResultVoid;
+  auto write(const std::string& name, std::string_view data) -> ResultVoid;
+  // Pushes every buffer to disk, waiting on the write behind thread if there
+  // is one. Also reports any error the background writes ran into.
+  auto flush() -> ResultVoid;
+  // Memory held by the per file buffers and those queued for write behind
+  auto buffered_bytes() -> size_t;
+
+ private:
+  auto hand_off(OutputFile& file) -> ResultVoid;
+  auto write_behind_loop() -> void;
+
+  size_t buffer_bytes;
+  FlushPolicy flush_policy;
+  bool write_behind;
+  std::unordered_map<std::string, size_t> slots;
+  std::vector<OutputFile> files;
+
+  // only used with write_behind
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::pair<std::FILE*, std::string>> pending;
+  bool writing;
+  bool stopping;
+  std::string background_error;
+  std::thread writer;
+};
@@ -0,0 +1,166 @@
+#include "Parallel.h"
+
+#include <atomic>
+#include <exception>
+#include <future>
+#include <thread>
+
+// How many chunks each exec job gets, more than one so a job which drew slow
+// commands doesn't hold up the end of the run
+constexpr static auto chunks_per_exec_job = size_t(8);
+
+auto is_line_local_command(const Command& command,
+    const CompiledCommand& compiled) -> bool {
+  if (command.address) {
+    return false;
+  }
+  switch (compiled.opcode) {
+    case Opcode::append:
+    case Opcode::branch:
+    case Opcode::change:
+    case Opcode::delete_:
+    case Opcode::insert:
+    case Opcode::prepend_file_name:
+    case Opcode::unamb_operations:
+    case Opcode::print_operations:
+    case Opcode::substitute:
+    case Opcode::branch_true:
+    case Opcode::branch_false:
+    case Opcode::assert_version:
+    case Opcode::translate:
+    case Opcode::zap:
+    case Opcode::verify_label:
+      return true;
+    default:
+      return false;
+  }
+}
+
+auto is_line_local(const Commands& commands, const Program& program) -> bool {
+  for (size_t i = 0; i < program.size(); i++) {
+    if (!is_line_local_command(commands[i], program[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto is_exec_local(const Commands& commands, const Program& program) -> bool {
+  auto executes = false;
+  for (size_t i = 0; i < program.size(); i++) {
+    if (program[i].opcode == Opcode::execute && !commands[i].address) {
+      executes = true;
+    } else if (!is_line_local_command(commands[i], program[i])) {
+      return false;
+    }
+  }
+  return executes;
+}
+
+// Cut as evenly as possible, then push each cut forward past the next newline
+// so no line is split between chunks
+auto split_lines(const std::string& input, size_t pieces)
+  -> std::vector<std::string> {
+  auto chunks = std::vector<std::string>();
+  size_t start = 0;
+  for (size_t i = 1; i <= pieces && start < input.size(); i++) {
+    auto end = input.size();
+    if (i < pieces) {
+      auto pos = find_delimiter(input, nl,
+          std::max(start, input.size() * i / pieces));
+      end = pos == std::string::npos
+        ? input.size()
+        : pos + std::string_view(nl).size();
+    }
+    chunks.push_back(input.substr(start, end - start));
+    start = end;
+  }
+  return chunks;
+}
+
+// Runs a copy of the script over every chunk on a pool of workers, each taking
+// the next chunk as soon as it is done with one, and joins the results in
+// input order. Every worker opens its own handles, so each gets its own shell
+// with ExecBackend::coprocess.
+auto run_chunks(const Context& context, std::vector<std::string> chunks,
+    size_t workers, ScriptRunner runner, const Options& options) -> std::string {
+  auto results = std::vector<std::string>(chunks.size());
+  auto errors = std::vector<std::exception_ptr>(chunks.size());
+  auto next = std::atomic<size_t>(0);
+  auto failed = std::atomic<bool>(false);
+  auto work = [&]() {
+    auto handles = std::shared_ptr<HandleTable>();
+    // chunks are taken in order, so once one fails every chunk before it has
+    // already been taken and will still finish
+    for (auto i = next++; i < chunks.size() && !failed; i = next++) {
+      try {
+        if (!handles) {
+          auto opened = open_handles(*context.commands, *context.program,
+              options);
+          if (!opened) {
+            throw std::runtime_error(std::string("execute: unable to load "
+                  "script: ") + opened.error());
+          }
+          handles = std::move(opened.value());
+          handles->progress = context.handles->progress;
+        }
+        auto worker = Context(
+            std::make_pair(context.file_stream.first, std::move(chunks[i])));
+        worker.handles = handles;
+        worker.commands = context.commands;
+        worker.program = context.program;
+        results[i] = runner(std::move(worker)).result;
+      } catch (...) {
+        errors[i] = std::current_exception();
+        failed = true;
+      }
+    }
+  };
+
+  auto pool = std::vector<std::future<void>>();
+  for (size_t i = 0; i < std::min(workers, chunks.size()); i++) {
+    pool.push_back(std::async(std::launch::async, work));
+  }
+  for (auto& worker : pool) {
+    worker.get();
+  }
+
+  // rethrow the error of the earliest failing chunk, which is the one the
+  // serial loop would have hit first
+  auto result = std::string();
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (errors[i]) {
+      std::rethrow_exception(errors[i]);
+    }
+    result += results[i];
+  }
+  return result;
+}
+
+auto execute_parallel(Context context, const Options& options,
+    ScriptRunner runner) -> std::string {
+  const auto& input = context.file_stream.second;
+  auto threads = options.threads == 0
+    ? std::max(std::thread::hardware_concurrency(), 1u)
+    : options.threads;
+  threads = std::min(threads,
+      input.size() / std::max(options.parallel_min_bytes, size_t(1)));
+  if (threads <= 1) {
+    return runner(std::move(context)).result;
+  }
+  return run_chunks(context, split_lines(input, threads), threads, runner,
+      options);
+}
+
+auto execute_exec_pool(Context context, const Options& options) -> std::string {
+  auto jobs = options.exec_jobs == 0
+    ? std::max(std::thread::hardware_concurrency(), 1u)
+    : options.exec_jobs;
+  if (jobs <= 1) {
+    return run_script(std::move(context)).result;
+  }
+  // no minimum size here, a single command can be worth a thread
+  return run_chunks(context,
+      split_lines(context.file_stream.second, jobs * chunks_per_exec_job),
+      jobs, run_script, options);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Context.h"
+
+// A script is line local if every command only looks at the current pattern
+// space (and constants like the file name), i.e. no hold space, no reading of
+// further input or side files, no writing of files, no execution and no
+// addresses (as they are line numbers). Such a script gives the same output
+// when the input is cut at any newline and the pieces are run separately.
+auto is_line_local(const Commands& commands, const Program& program) -> bool;
+// Line local apart from at least one unaddressed execute. Lines are then still
+// independent as far as sim is concerned, as long as the shell commands don't
+// depend on each other, which is why running these concurrently is opt in.
+auto is_exec_local(const Commands& commands, const Program& program) -> bool;
+
+// Splits context.file_stream at newlines into one chunk per worker thread,
+// runs a copy of the script over each with runner and joins the results in
+// input order. Runs on the calling thread when the input is too small to be
+// worth it. Any error is the one of the earliest failing chunk.
+auto execute_parallel(Context context, const Options& options,
+    ScriptRunner runner = run_script) -> std::string;
+
+// For is_exec_local scripts, splits context.file_stream into several chunks
+// per job and keeps options.exec_jobs of them running at a time, each job with
+// its own shell (or popen). The output is joined in input order.
+auto execute_exec_pool(Context context, const Options& options) -> std::string;
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <sstream>
+#include <unordered_set>
 
 using json = nlohmann::ordered_json;
 
@@ -47,3 +48,161 @@ auto parse_json(const std::string& contents) -> ResultCommands {
   }
   return result;
 }
+
+// Builds Commands straight from nlohmann's SAX events, one level per state.
+// Errors are the ones parse_json gives for the same script. A name seen twice
+// stops it, parse_json's document keeps one command per name.
+class CommandsBuilder {
+public:
+  Commands commands;
+  std::string error;
+  bool repeated_name = false;
+
+  auto null() -> bool { return value(); }
+  auto boolean(bool) -> bool { return value(); }
+  auto number_integer(json::number_integer_t number) -> bool {
+    return address(static_cast<uint64_t>(number));
+  }
+  auto number_unsigned(json::number_unsigned_t number) -> bool {
+    return address(number);
+  }
+  auto number_float(json::number_float_t number, const json::string_t&) -> bool {
+    return address(static_cast<uint64_t>(number));
+  }
+  auto binary(json::binary_t&) -> bool { return value(); }
+
+  auto string(json::string_t& text) -> bool {
+    if (state != State::arguments) {
+      return value();
+    }
+    commands.back().arguments->push_back(std::move(text));
+    return true;
+  }
+
+  auto start_object(size_t) -> bool {
+    if (state == State::script) {
+      state = State::commands;
+      return true;
+    } else if (state == State::command) {
+      commands.emplace_back(std::move(name), std::nullopt, std::nullopt);
+      state = State::fields;
+      return true;
+    }
+    return value();
+  }
+
+  auto key(json::string_t& text) -> bool {
+    if (state == State::commands) {
+      if (!names.insert(text).second) {
+        repeated_name = true;
+        return false;
+      }
+      name = std::move(text);
+      state = State::command;
+    } else {
+      field = std::move(text);
+      state = State::field;
+    }
+    return true;
+  }
+
+  auto end_object() -> bool {
+    state = state == State::fields ? State::commands : State::done;
+    return true;
+  }
+
+  auto start_array(size_t) -> bool {
+    if (state != State::field || field != "arguments") {
+      return value();
+    }
+    commands.back().arguments = Strings();
+    state = State::arguments;
+    return true;
+  }
+
+  auto end_array() -> bool {
+    state = State::fields;
+    return true;
+  }
+
+  auto parse_error(size_t, const std::string&,
+      const nlohmann::detail::exception& exception) -> bool {
+    error = exception.what();
+    return false;
+  }
+
+private:
+  enum class State {
+    // before the outer object
+    script,
+    // between commands, expecting a name
+    commands,
+    // after a name, expecting its object
+    command,
+    // inside a command's object, expecting a key
+    fields,
+    // after a key, expecting its value
+    field,
+    arguments,
+    done,
+  };
+
+  // A value the schema has no place for where it turned up
+  auto value() -> bool {
+    if (state == State::command) {
+      error = std::string("parse_json: command: ") + name
+        + std::string(" is not a json object, see the documentation");
+    } else if (state == State::script) {
+      error = "parse_json: the script is not a json object";
+    } else {
+      error = std::string("parse_json: key: ") + commands.back().name
+        + std::string(" is either not supported or has a value which is not "
+            "supported under the current schema");
+    }
+    return false;
+  }
+
+  auto address(uint64_t number) -> bool {
+    if (state != State::field || field != "address") {
+      return value();
+    }
+    commands.back().address = number;
+    state = State::fields;
+    return true;
+  }
+
+  State state = State::script;
+  std::string name;
+  std::string field;
+  std::unordered_set<std::string> names;
+};
+
+auto parse_json_stream(const std::string& contents) -> ResultCommands {
+  auto builder = CommandsBuilder();
+  if (!json::sax_parse(contents, &builder)) {
+    // which of the repeats parse_json keeps, and where, is up to its document
+    if (builder.repeated_name) {
+      return parse_json(contents);
+    }
+    return tl::make_unexpected(builder.error);
+  }
+  return std::move(builder.commands);
+}
+
+auto commands_to_json(const Commands& commands) -> std::string {
+  auto result = std::string("{");
+  for (size_t i = 0; i < commands.size(); i++) {
+    const auto& command = commands[i];
+    auto value = json::object();
+    if (command.address) {
+      value["address"] = *command.address;
+    }
+    if (command.arguments) {
+      value["arguments"] = *command.arguments;
+    }
+    result += (i == 0 ? "\n  " : ",\n  ") + json(command.name).dump()
+      + std::string(": ") + value.dump();
+  }
+  result += commands.empty() ? "}\n" : "\n}\n";
+  return result;
+}
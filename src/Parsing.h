@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <optional>
 #include <string>
 #include <tl/expected.hpp>
@@ -29,4 +30,15 @@ auto file_to_string(const std::string& file_name)
   -> tl::expected<std::string, std::string>;
 
 using ResultCommands = tl::expected<Commands, std::string>;
+// What execute turns the script's text into Commands with
+using TextToCommands = std::function<ResultCommands(const std::string&)>;
 auto parse_json(const std::string& file_name) -> ResultCommands;
+// parse_json without building a json document first, straight from the
+// parser's events into Commands. It gives exactly what parse_json gives, a
+// script which repeats a command name is handed to parse_json itself.
+auto parse_json_stream(const std::string& contents) -> ResultCommands;
+
+// The inverse of parse_json, one command per line. Repeated names are written
+// out as is so the output is for reading rather than feeding back into
+// parse_json.
+auto commands_to_json(const Commands& commands) -> std::string;
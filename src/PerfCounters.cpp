@@ -0,0 +1,102 @@
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+auto hardware_event_name(HardwareEvent event) -> const char* {
+  switch (event) {
+    case HardwareEvent::cycles: return "cycles";
+    case HardwareEvent::instructions: return "instructions";
+    case HardwareEvent::branch_misses: return "branch_misses";
+    case HardwareEvent::cache_misses: return "cache_misses";
+  }
+  return "";
+}
+
+#if defined(__linux__)
+// glibc has no wrapper for it
+auto perf_event_open(perf_event_attr& attributes, int group) -> int {
+  return static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1,
+        group, PERF_FLAG_FD_CLOEXEC));
+}
+
+const PerfEvents hardware_perf_events = {{
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+}};
+#else
+const PerfEvents hardware_perf_events = {};
+#endif
+
+auto PerfCounters::open([[maybe_unused]] const PerfEvents& events)
+  -> tl::expected<std::unique_ptr<PerfCounters>, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("PerfCounters: hardware counters only supported "
+      "for linux");
+#else
+  auto counters = std::unique_ptr<PerfCounters>(new PerfCounters());
+  for (size_t i = 0; i < hardware_event_count; i++) {
+    auto attributes = perf_event_attr();
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = events[i].type;
+    attributes.config = events[i].config;
+    // the leader starts disabled so the group starts counting together
+    attributes.disabled = i == 0;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_GROUP
+      | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    auto fd = perf_event_open(attributes, i == 0 ? -1 : counters->fds[0]);
+    if (fd < 0) {
+      return tl::make_unexpected(std::string("PerfCounters: perf_event_open() "
+            "failed for ") + hardware_event_name(static_cast<HardwareEvent>(i))
+          + ": " + std::strerror(errno));
+    }
+    counters->fds[i] = fd;
+  }
+  ::ioctl(counters->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ::ioctl(counters->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return counters;
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+  for (auto fd : fds) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+#endif
+}
+
+auto PerfCounters::read() -> HardwareCounts {
+  auto counts = HardwareCounts{};
+#if defined(__linux__)
+  // PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, then the values
+  auto buffer = std::array<uint64_t, 3 + hardware_event_count>{};
+  auto size = static_cast<ssize_t>(sizeof(buffer));
+  if (::read(fds[0], buffer.data(), sizeof(buffer)) != size
+      || buffer[0] != hardware_event_count) {
+    return counts;
+  }
+  auto enabled = buffer[1];
+  auto running = buffer[2];
+  for (size_t i = 0; i < hardware_event_count; i++) {
+    counts[i] = running == 0 || running == enabled
+      ? buffer[3 + i]
+      : static_cast<uint64_t>(static_cast<double>(buffer[3 + i])
+          * static_cast<double>(enabled) / static_cast<double>(running));
+  }
+#endif
+  return counts;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tl/expected.hpp>
+
+// What PerfCounters counts, in this order
+enum class HardwareEvent {
+  cycles,
+  instructions,
+  branch_misses,
+  cache_misses,
+};
+constexpr auto hardware_event_count = size_t(4);
+using HardwareCounts = std::array<uint64_t, hardware_event_count>;
+
+auto hardware_event_name(HardwareEvent event) -> const char*;
+
+// A perf_event_attr type and config, what PerfCounters opens for each
+// HardwareEvent slot
+struct PerfEvent {
+  uint32_t type;
+  uint64_t config;
+};
+using PerfEvents = std::array<PerfEvent, hardware_event_count>;
+
+// PERF_TYPE_HARDWARE with the config of every HardwareEvent, what open uses
+// unless it's given other events (all 0 off linux)
+extern const PerfEvents hardware_perf_events;
+
+// The CPU's cycle, instruction, branch miss and cache miss counters for the
+// calling thread in user space, opened through perf_event_open as one group
+// so they're read together in a single read(). Linux only, and often not
+// allowed at all in containers or with perf_event_paranoid above 2, in which
+// case open fails and the caller carries on with timers alone. Other events,
+// e.g. software ones, can be counted in the same slots by passing them to open.
+class PerfCounters {
+public:
+  static auto open(const PerfEvents& events = hardware_perf_events)
+    -> tl::expected<std::unique_ptr<PerfCounters>, std::string>;
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  auto operator=(const PerfCounters&) -> PerfCounters& = delete;
+
+  // Counts since open, scaled up if the kernel had to multiplex the group
+  auto read() -> HardwareCounts;
+
+private:
+  PerfCounters() = default;
+
+  std::array<int, hardware_event_count> fds = {-1, -1, -1, -1};
+};
@@ -0,0 +1,177 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <numeric>
+
+auto profile_by_opcode(const Commands& commands, const Profile& profile)
+  -> std::vector<OpcodeProfile> {
+  auto opcodes = std::array<OpcodeProfile, opcode_count>();
+  for (size_t i = 0; i < profile.size(); i++) {
+    auto opcode = lookup_opcode(commands[i].name).value_or(Opcode::custom);
+    auto& entry = opcodes[static_cast<size_t>(opcode)];
+    const auto& command = profile[i];
+    entry.opcode = opcode;
+    entry.commands++;
+    entry.counts.invocations += command.invocations;
+    entry.counts.address_hits += command.address_hits;
+    entry.counts.address_skips += command.address_skips;
+    entry.counts.nanoseconds += command.nanoseconds;
+    entry.counts.bytes_in += command.bytes_in;
+    entry.counts.bytes_out += command.bytes_out;
+    entry.counts.jumps_taken += command.jumps_taken;
+    for (size_t event = 0; event < hardware_event_count; event++) {
+      entry.counts.hardware[event] += command.hardware[event];
+    }
+  }
+  auto result = std::vector<OpcodeProfile>();
+  std::copy_if(opcodes.begin(), opcodes.end(), std::back_inserter(result),
+      [](const auto& entry) { return entry.commands != 0; });
+  return result;
+}
+
+auto has_hardware_counts(const Profile& profile) -> bool {
+  return std::any_of(profile.begin(), profile.end(), [](const auto& command) {
+    return std::any_of(command.hardware.begin(), command.hardware.end(),
+        [](auto count) { return count != 0; });
+  });
+}
+
+// The counting columns of a report row, up to the name
+auto append_counts(std::string& report, const CommandProfile& command,
+    uint64_t total, bool hardware) -> void {
+  auto line = std::array<char, 256>();
+  std::snprintf(line.data(), line.size(),
+      "%10.3f %5.1f%% %10llu %10llu %10llu %8llu %12llu %12llu ",
+      static_cast<double>(command.nanoseconds) / 1e6,
+      total == 0 ? 0.0 : 100.0 * static_cast<double>(command.nanoseconds)
+        / static_cast<double>(total),
+      static_cast<unsigned long long>(command.invocations),
+      static_cast<unsigned long long>(command.address_hits),
+      static_cast<unsigned long long>(command.address_skips),
+      static_cast<unsigned long long>(command.jumps_taken),
+      static_cast<unsigned long long>(command.bytes_in),
+      static_cast<unsigned long long>(command.bytes_out));
+  report += line.data();
+  if (hardware) {
+    const auto& counts = command.hardware;
+    auto cycles = counts[size_t(HardwareEvent::cycles)];
+    auto instructions = counts[size_t(HardwareEvent::instructions)];
+    std::snprintf(line.data(), line.size(),
+        "%14llu %14llu %6.2f %12llu %12llu ",
+        static_cast<unsigned long long>(cycles),
+        static_cast<unsigned long long>(instructions),
+        cycles == 0 ? 0.0 : static_cast<double>(instructions)
+          / static_cast<double>(cycles),
+        static_cast<unsigned long long>(
+          counts[size_t(HardwareEvent::branch_misses)]),
+        static_cast<unsigned long long>(
+          counts[size_t(HardwareEvent::cache_misses)]));
+    report += line.data();
+  }
+}
+
+// The column headings of a report, the last two are the caller's
+auto append_heading(std::string& report, bool hardware, const char* number,
+    const char* name) -> void {
+  auto line = std::array<char, 256>();
+  std::snprintf(line.data(), line.size(),
+      "%10s %6s %10s %10s %10s %8s %12s %12s ", "time(ms)", "share",
+      "calls", "hits", "skips", "jumps", "bytes in", "bytes out");
+  report += line.data();
+  if (hardware) {
+    std::snprintf(line.data(), line.size(), "%14s %14s %6s %12s %12s ",
+        "cycles", "instructions", "ipc", "branch miss", "cache miss");
+    report += line.data();
+  }
+  std::snprintf(line.data(), line.size(), "%5s  %s\n", number, name);
+  report += line.data();
+}
+
+auto profile_report(const Commands& commands, const Profile& profile)
+  -> std::string {
+  auto order = std::vector<size_t>(profile.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&profile](auto a, auto b) {
+    return profile[a].nanoseconds > profile[b].nanoseconds;
+  });
+  auto total = uint64_t(0);
+  for (const auto& command : profile) {
+    total += command.nanoseconds;
+  }
+
+  auto hardware = has_hardware_counts(profile);
+
+  auto report = std::string();
+  auto line = std::array<char, 256>();
+  append_heading(report, hardware, "#", "command");
+  for (auto i : order) {
+    append_counts(report, profile[i], total, hardware);
+    std::snprintf(line.data(), line.size(), "%5zu  %s\n", i,
+        commands[i].name.c_str());
+    report += line.data();
+  }
+
+  auto opcodes = profile_by_opcode(commands, profile);
+  std::stable_sort(opcodes.begin(), opcodes.end(), [](const auto& a, const auto& b) {
+    return a.counts.nanoseconds > b.counts.nanoseconds;
+  });
+  report += "\n";
+  append_heading(report, hardware, "cmds", "opcode");
+  for (const auto& opcode : opcodes) {
+    append_counts(report, opcode.counts, total, hardware);
+    std::snprintf(line.data(), line.size(), "%5llu  %.*s\n",
+        static_cast<unsigned long long>(opcode.commands),
+        static_cast<int>(opcode_name(opcode.opcode).size()),
+        opcode_name(opcode.opcode).data());
+    report += line.data();
+  }
+  return report;
+}
+
+// The counts of a json entry, after whatever names it
+auto add_counts(nlohmann::ordered_json& entry, const CommandProfile& command,
+    bool hardware) -> void {
+  entry["invocations"] = command.invocations;
+  entry["address_hits"] = command.address_hits;
+  entry["address_skips"] = command.address_skips;
+  entry["nanoseconds"] = command.nanoseconds;
+  entry["bytes_in"] = command.bytes_in;
+  entry["bytes_out"] = command.bytes_out;
+  entry["jumps_taken"] = command.jumps_taken;
+  for (size_t event = 0; hardware && event < hardware_event_count; event++) {
+    entry[hardware_event_name(static_cast<HardwareEvent>(event))]
+      = command.hardware[event];
+  }
+}
+
+auto profile_json(const Commands& commands, const Profile& profile)
+  -> std::string {
+  auto hardware = has_hardware_counts(profile);
+  auto by_command = nlohmann::ordered_json::array();
+  for (size_t i = 0; i < profile.size(); i++) {
+    auto entry = nlohmann::ordered_json({
+      {"index", i},
+      {"name", commands[i].name},
+    });
+    add_counts(entry, profile[i], hardware);
+    by_command.push_back(std::move(entry));
+  }
+  auto by_opcode = nlohmann::ordered_json::array();
+  for (const auto& opcode : profile_by_opcode(commands, profile)) {
+    auto entry = nlohmann::ordered_json({
+      {"opcode", opcode_name(opcode.opcode)},
+      {"commands", opcode.commands},
+    });
+    add_counts(entry, opcode.counts, hardware);
+    by_opcode.push_back(std::move(entry));
+  }
+  auto result = nlohmann::ordered_json({
+    {"commands", std::move(by_command)},
+    {"opcodes", std::move(by_opcode)},
+  });
+  return result.dump(2) + "\n";
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CommandTable.h"
+#include "Parsing.h"
+#include "PerfCounters.h"
+
+// What run_profiled saw of one command of the script, indexed the same as
+// Context::commands
+struct CommandProfile {
+  // times the command was reached
+  uint64_t invocations = 0;
+  // of those, how many had no address or the address matched the line
+  uint64_t address_hits = 0;
+  uint64_t address_skips = 0;
+  // steady_clock time spent in the command's semantic function
+  uint64_t nanoseconds = 0;
+  // size of the pattern space going in and coming out, summed
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  // b, t and T which jumped, D which restarted the script
+  uint64_t jumps_taken = 0;
+  // summed PerfCounters deltas over the semantic function, all 0 when the
+  // run wasn't counting them, indexed by HardwareEvent
+  HardwareCounts hardware = {};
+};
+using Profile = std::vector<CommandProfile>;
+
+// Every command of the script with one opcode, their counts summed
+struct OpcodeProfile {
+  Opcode opcode = Opcode::custom;
+  // how many commands of the script have the opcode
+  uint64_t commands = 0;
+  CommandProfile counts = {};
+};
+
+// One entry per opcode the script uses, in Opcode order. Commands added
+// through register_command all count as Opcode::custom.
+auto profile_by_opcode(const Commands& commands, const Profile& profile)
+  -> std::vector<OpcodeProfile>;
+
+// Whether any command has hardware counts, the reports only show them if so
+auto has_hardware_counts(const Profile& profile) -> bool;
+
+// One line per command, slowest first, then one per opcode, slowest first
+auto profile_report(const Commands& commands, const Profile& profile)
+  -> std::string;
+// An object with a "commands" array in script order, each with the command's
+// index and name, and an "opcodes" array in profile_by_opcode's order
+auto profile_json(const Commands& commands, const Profile& profile)
+  -> std::string;
@@ -0,0 +1,118 @@
+#include "Progress.h"
+
+#include <array>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// how often the thread checks for SIGUSR1
+constexpr static auto signal_poll = std::chrono::milliseconds(100);
+
+namespace {
+  // only ever set by the handler and cleared by the reporter thread
+  volatile std::sig_atomic_t report_requested = 0;
+
+  extern "C" auto request_report(int) -> void {
+    report_requested = 1;
+  }
+}
+
+auto progress_line(uint64_t lines, uint64_t bytes, uint64_t total_bytes,
+    std::chrono::duration<double> elapsed) -> std::string {
+  auto seconds = std::max(elapsed.count(), 1e-9);
+  auto bytes_per_second = static_cast<double>(bytes) / seconds;
+  auto line = std::array<char, 256>();
+  auto length = std::snprintf(line.data(), line.size(),
+      "sim: %llu lines, %.1f MB in %.1fs, %.0f lines/s, %.2f MB/s",
+      static_cast<unsigned long long>(lines),
+      static_cast<double>(bytes) / 1e6, elapsed.count(),
+      static_cast<double>(lines) / seconds, bytes_per_second / 1e6);
+  auto result = std::string(line.data(), static_cast<size_t>(length));
+  if (total_bytes > 0) {
+    auto remaining = static_cast<double>(total_bytes - std::min(bytes, total_bytes));
+    length = std::snprintf(line.data(), line.size(), ", %.1f%% read",
+        100.0 * static_cast<double>(bytes) / static_cast<double>(total_bytes));
+    result.append(line.data(), static_cast<size_t>(length));
+    if (bytes_per_second > 0) {
+      length = std::snprintf(line.data(), line.size(), ", eta %.0fs",
+          remaining / bytes_per_second);
+      result.append(line.data(), static_cast<size_t>(length));
+    }
+  }
+  return result + "\n";
+}
+
+ProgressReporter::ProgressReporter(const ProgressCounters& counters,
+    uint64_t total_bytes, std::chrono::milliseconds interval,
+    std::string status_file)
+  : counters(counters),
+    total_bytes(total_bytes),
+    interval(interval),
+    status_file(std::move(status_file)),
+    start(std::chrono::steady_clock::now()),
+    stopping(false) {
+  report_requested = 0;
+  struct sigaction action = {};
+  action.sa_handler = request_report;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, &previous_action);
+  reporter = std::thread([this]() { loop(); });
+}
+
+ProgressReporter::~ProgressReporter() {
+  stop();
+}
+
+auto ProgressReporter::stop() -> void {
+  if (!reporter.joinable()) {
+    return;
+  }
+  {
+    auto lock = std::lock_guard(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  reporter.join();
+  sigaction(SIGUSR1, &previous_action, nullptr);
+}
+
+auto ProgressReporter::finish() -> void {
+  stop();
+  report();
+}
+
+auto ProgressReporter::report() -> void {
+  auto line = progress_line(counters.lines.load(std::memory_order_relaxed),
+      counters.bytes.load(std::memory_order_relaxed), total_bytes,
+      std::chrono::steady_clock::now() - start);
+  if (status_file.empty()) {
+    std::cerr << line << std::flush;
+  } else {
+    auto temporary = status_file + ".tmp";
+    if (std::ofstream(temporary, std::ios::trunc) << line) {
+      auto error = std::error_code();
+      std::filesystem::rename(temporary, status_file, error);
+    }
+  }
+}
+
+auto ProgressReporter::loop() -> void {
+  auto next_report = std::chrono::steady_clock::now() + interval;
+  auto lock = std::unique_lock(mutex);
+  while (!stopping) {
+    changed.wait_for(lock, signal_poll, [this]() { return stopping; });
+    if (stopping) {
+      break;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto periodic = interval.count() > 0 && now >= next_report;
+    if (report_requested || periodic) {
+      report_requested = 0;
+      report();
+      next_report = now + interval;
+    }
+  }
+}
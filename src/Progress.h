@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Bumped by the executors after every line (run_batched after every batch),
+// read by ProgressReporter. Relaxed, nothing orders against these.
+struct ProgressCounters {
+  std::atomic<uint64_t> lines = 0;
+  std::atomic<uint64_t> bytes = 0;
+
+  auto add(uint64_t line_count, uint64_t byte_count) -> void {
+    lines.fetch_add(line_count, std::memory_order_relaxed);
+    bytes.fetch_add(byte_count, std::memory_order_relaxed);
+  }
+};
+
+// A background thread printing lines/s, MB/s, how much of the input has been
+// read and an ETA, every interval and whenever the process gets SIGUSR1 (like
+// dd). An interval of 0 only reports on SIGUSR1. Reports go to stderr, or
+// replace status_file (by renaming a whole new file over it, so a reader never
+// sees it half written) if it isn't empty. Whatever SIGUSR1 did before is
+// restored once the thread stops, sim may be a library inside someone else's
+// process.
+class ProgressReporter {
+public:
+  ProgressReporter(const ProgressCounters& counters, uint64_t total_bytes,
+      std::chrono::milliseconds interval, std::string status_file);
+  // Stops the thread without a last report, see finish
+  ~ProgressReporter();
+
+  ProgressReporter(const ProgressReporter&) = delete;
+  auto operator=(const ProgressReporter&) -> ProgressReporter& = delete;
+
+  // Stops the thread and reports the totals of the run
+  auto finish() -> void;
+
+private:
+  auto stop() -> void;
+  auto report() -> void;
+  auto loop() -> void;
+
+  const ProgressCounters& counters;
+  uint64_t total_bytes;
+  std::chrono::milliseconds interval;
+  std::string status_file;
+  std::chrono::steady_clock::time_point start;
+  struct sigaction previous_action;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool stopping;
+  std::thread reporter;
+};
+
+// The line ProgressReporter writes
+auto progress_line(uint64_t lines, uint64_t bytes, uint64_t total_bytes,
+    std::chrono::duration<double> elapsed) -> std::string;
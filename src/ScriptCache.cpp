@@ -0,0 +1,284 @@
+#include "ScriptCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+
+#include "FileCache.h"
+#include "Version.h"
+
+// Layout, every integer little endian as this machine writes it (the magic
+// catches an entry moved across):
+//   magic, format, sim_version, digest of the script's text
+//   string count, then each string as length and bytes
+//   command count, then each command as
+//     name, opcode, flags, address, slot, argument count, arguments
+// where strings are indices into the string table. Every name and argument
+// is stored once however often the script repeats it.
+constexpr static auto cache_magic = uint32_t(0x434d4953);
+constexpr static auto cache_format = uint32_t(3);
+// The least a string (its length) and a command (everything but its
+// arguments) take up, so a damaged count is caught before allocating for it
+constexpr static auto min_string_bytes = sizeof(uint32_t);
+constexpr static auto min_command_bytes = 3 * sizeof(uint32_t)
+  + 2 * sizeof(uint8_t) + sizeof(uint64_t);
+
+enum CommandFlags : uint8_t {
+  has_arguments = 1,
+  has_address = 2,
+  has_slot = 4,
+};
+
+auto script_cache_key(const std::string& command_text, bool optimize)
+  -> std::string {
+  // FNV-1a, 64 bits, the text goes last so the version and flag can't be
+  // confused with the end of a script
+  auto hash = uint64_t(14695981039346656037ull);
+  auto mix = [&hash](std::string_view bytes) {
+    for (auto c : bytes) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+    }
+  };
+  mix(sim_version);
+  mix(std::string_view(optimize ? "\1" : "\0", 1));
+  mix(command_text);
+  auto key = std::string(16, '0');
+  constexpr auto digits = "0123456789abcdef";
+  for (size_t i = 0; i < key.size(); i++) {
+    key[key.size() - 1 - i] = digits[(hash >> (4 * i)) & 0xf];
+  }
+  return key + "-" + std::to_string(command_text.size()) + ".simc";
+}
+
+// A second hash of the script, kept in the entry and checked on load, so two
+// scripts whose keys collide can't be mistaken for each other. Word at a time
+// with murmur3's 64 bit mixing, nothing in common with the key's FNV-1a.
+auto script_digest(std::string_view command_text) -> uint64_t {
+  auto hash = uint64_t(0x9e3779b97f4a7c15ull) ^ command_text.size();
+  for (size_t i = 0; i < command_text.size(); i += sizeof(uint64_t)) {
+    auto word = uint64_t(0);
+    std::memcpy(&word, command_text.data() + i,
+        std::min(sizeof(word), command_text.size() - i));
+    word *= 0xff51afd7ed558ccdull;
+    word ^= word >> 33;
+    hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+class CacheWriter {
+public:
+  template<typename T>
+  auto integer(T value) -> void {
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  auto string(std::string_view value) -> void {
+    integer(static_cast<uint32_t>(value.size()));
+    bytes.append(value);
+  }
+
+  std::string bytes;
+};
+
+// Reads out of the mapped entry, any read past the end fails every read after
+// it so the loader only checks once at the end
+class CacheReader {
+public:
+  explicit CacheReader(std::string_view bytes) : bytes(bytes) {}
+
+  template<typename T>
+  auto integer() -> T {
+    auto value = T();
+    if (!take(sizeof(value))) {
+      return value;
+    }
+    std::memcpy(&value, bytes.data() + position - sizeof(value), sizeof(value));
+    return value;
+  }
+
+  auto string() -> std::string_view {
+    auto size = integer<uint32_t>();
+    if (!take(size)) {
+      return {};
+    }
+    return bytes.substr(position - size, size);
+  }
+
+  auto good() const -> bool { return ok; }
+  auto remaining() const -> size_t { return ok ? bytes.size() - position : 0; }
+  auto done() const -> bool { return ok && position == bytes.size(); }
+
+private:
+  auto take(size_t size) -> bool {
+    ok = ok && bytes.size() - position >= size;
+    if (ok) {
+      position += size;
+    }
+    return ok;
+  }
+
+  std::string_view bytes;
+  size_t position = 0;
+  bool ok = true;
+};
+
+auto load_cached_script(const std::string& directory, const std::string& key,
+    const std::string& command_text) -> std::optional<CachedScript> {
+  auto path = std::filesystem::path(directory) / key;
+  auto error = std::error_code();
+  if (!std::filesystem::exists(path, error)) {
+    return std::nullopt;
+  }
+  auto file = MappedFile::load(path.string(), true);
+  if (!file) {
+    return std::nullopt;
+  }
+  auto reader = CacheReader((*file)->contents());
+  if (reader.integer<uint32_t>() != cache_magic
+      || reader.integer<uint32_t>() != cache_format
+      || reader.string() != sim_version
+      || reader.integer<uint64_t>() != script_digest(command_text)) {
+    return std::nullopt;
+  }
+
+  auto string_count = reader.integer<uint32_t>();
+  if (string_count > reader.remaining() / min_string_bytes) {
+    return std::nullopt;
+  }
+  auto strings = std::vector<std::string>(string_count);
+  for (auto& string : strings) {
+    string = reader.string();
+    if (!reader.good()) {
+      return std::nullopt;
+    }
+  }
+  auto indices_valid = true;
+  auto string_at = [&strings, &indices_valid](uint32_t index) -> std::string {
+    if (index >= strings.size()) {
+      indices_valid = false;
+      return {};
+    }
+    return strings[index];
+  };
+
+  auto script = CachedScript();
+  auto count = reader.integer<uint32_t>();
+  if (count > reader.remaining() / min_command_bytes) {
+    return std::nullopt;
+  }
+  script.commands.reserve(count);
+  script.program.reserve(count);
+  for (uint32_t i = 0; i < count && reader.good(); i++) {
+    auto command = Command();
+    command.name = string_at(reader.integer<uint32_t>());
+    auto opcode = reader.integer<uint8_t>();
+    auto flags = reader.integer<uint8_t>();
+    auto address = reader.integer<uint64_t>();
+    auto slot = reader.integer<uint32_t>();
+    auto argument_count = reader.integer<uint32_t>();
+    if (flags & has_arguments) {
+      command.arguments = Strings();
+      for (uint32_t j = 0; j < argument_count && reader.good(); j++) {
+        command.arguments->push_back(string_at(reader.integer<uint32_t>()));
+      }
+    }
+    if (flags & has_address) {
+      command.address = address;
+    }
+    if (opcode >= opcode_count) {
+      return std::nullopt;
+    }
+    auto function = semantic_function(static_cast<Opcode>(opcode),
+        command.name);
+    if (!function) {
+      return std::nullopt;
+    }
+    script.program.push_back({static_cast<Opcode>(opcode), *function,
+        flags & has_slot ? std::optional<size_t>(slot) : std::nullopt});
+    script.commands.push_back(std::move(command));
+  }
+  if (!indices_valid || !reader.done()) {
+    return std::nullopt;
+  }
+  return script;
+}
+
+auto store_cached_script(const std::string& directory, const std::string& key,
+    const std::string& command_text, const Commands& commands,
+    const Program& program) -> tl::expected<void, std::string> {
+  auto writer = CacheWriter();
+  writer.integer(cache_magic);
+  writer.integer(cache_format);
+  writer.string(sim_version);
+  writer.integer(script_digest(command_text));
+
+  auto indices = std::unordered_map<std::string_view, uint32_t>();
+  auto order = std::vector<std::string_view>();
+  auto intern = [&indices, &order](const std::string& string) {
+    auto [entry, added] = indices.emplace(string,
+        static_cast<uint32_t>(order.size()));
+    if (added) {
+      order.push_back(string);
+    }
+    return entry->second;
+  };
+  auto body = CacheWriter();
+  body.integer(static_cast<uint32_t>(commands.size()));
+  for (size_t i = 0; i < commands.size(); i++) {
+    const auto& command = commands[i];
+    const auto& compiled = program[i];
+    auto flags = uint8_t(0);
+    flags |= command.arguments ? has_arguments : 0;
+    flags |= command.address ? has_address : 0;
+    flags |= compiled.slot ? has_slot : 0;
+    body.integer(intern(command.name));
+    body.integer(static_cast<uint8_t>(compiled.opcode));
+    body.integer(flags);
+    body.integer(command.address.value_or(0));
+    body.integer(static_cast<uint32_t>(compiled.slot.value_or(0)));
+    body.integer(static_cast<uint32_t>(command.arguments
+          ? command.arguments->size()
+          : 0));
+    if (command.arguments) {
+      for (const auto& argument : *command.arguments) {
+        body.integer(intern(argument));
+      }
+    }
+  }
+  writer.integer(static_cast<uint32_t>(order.size()));
+  for (auto string : order) {
+    writer.string(string);
+  }
+  writer.bytes += body.bytes;
+
+  auto error = std::error_code();
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    return tl::make_unexpected("store_cached_script: unable to create "
+        "directory: " + directory);
+  }
+  auto path = std::filesystem::path(directory) / key;
+  auto temporary = path;
+  temporary += ".tmp" + std::to_string(std::random_device()());
+  {
+    auto file = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+    if (!(file << writer.bytes) || !file.flush()) {
+      std::filesystem::remove(temporary, error);
+      return tl::make_unexpected("store_cached_script: unable to write: "
+          + temporary.string());
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    return tl::make_unexpected("store_cached_script: unable to write: "
+        + path.string());
+  }
+  return {};
+}
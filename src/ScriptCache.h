@@ -0,0 +1,34 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <tl/expected.hpp>
+
+#include "Context.h"
+
+// A loaded script as execute needs it, straight out of the cache
+struct CachedScript {
+  Commands commands;
+  Program program;
+};
+
+// File name of the cache entry for a script, a hash of the script's text,
+// sim_version and whether it was optimized, so a new sim or --optimize never
+// picks up an old entry
+auto script_cache_key(const std::string& command_text, bool optimize)
+  -> std::string;
+
+// The commands and program stored under key in directory, nullopt when there
+// is no entry or it can't be used: written by another format, for another
+// script whose key collided, damaged or truncated, naming a custom command
+// which isn't registered. The file is memory mapped and read in one pass,
+// nothing is parsed.
+auto load_cached_script(const std::string& directory, const std::string& key,
+    const std::string& command_text) -> std::optional<CachedScript>;
+
+// Writes the commands and program command_text compiled to under key in
+// directory, creating it if needed. Written to a temporary file and renamed
+// over, so concurrent runs only ever see whole entries.
+auto store_cached_script(const std::string& directory, const std::string& key,
+    const std::string& command_text, const Commands& commands,
+    const Program& program) -> tl::expected<void, std::string>;
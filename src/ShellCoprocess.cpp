@@ -0,0 +1,131 @@
+#include "ShellCoprocess.h"
+
+#include <array>
+
+#include "Output.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+// read() size when collecting a command's output
+constexpr static auto read_block_bytes = size_t(1) << 16;
+
+#if defined(__linux__)
+// Wrapped in single quotes for eval, a quote in the command closes the quoted
+// string, adds an escaped quote and opens a new one
+auto shell_quote(std::string_view command) -> std::string {
+  auto quoted = std::string("'");
+  for (auto c : command) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "'";
+}
+#endif
+
+auto ShellCoprocess::spawn()
+  -> tl::expected<std::unique_ptr<ShellCoprocess>, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("ShellCoprocess: command line execution only "
+      "supported for linux");
+#else
+  auto shell = std::unique_ptr<ShellCoprocess>(new ShellCoprocess());
+  int input[2];
+  int output[2];
+  if (::pipe2(input, O_CLOEXEC) != 0) {
+    return tl::make_unexpected("ShellCoprocess: pipe() failed");
+  }
+  if (::pipe2(output, O_CLOEXEC) != 0) {
+    ::close(input[0]);
+    ::close(input[1]);
+    return tl::make_unexpected("ShellCoprocess: pipe() failed");
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, input[0], STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+  char shell_name[] = "sh";
+  char* arguments[] = {shell_name, nullptr};
+  pid_t pid = -1;
+  auto spawned = posix_spawn(&pid, "/bin/sh", &actions, nullptr, arguments,
+      environ);
+  posix_spawn_file_actions_destroy(&actions);
+  ::close(input[0]);
+  ::close(output[1]);
+  if (spawned != 0) {
+    ::close(input[1]);
+    ::close(output[0]);
+    return tl::make_unexpected("ShellCoprocess: posix_spawn() failed");
+  }
+
+  shell->pid = pid;
+  shell->to_shell = input[1];
+  shell->from_shell = output[0];
+  return shell;
+#endif
+}
+
+ShellCoprocess::~ShellCoprocess() {
+#if defined(__linux__)
+  // the shell exits once it reads end of file
+  if (to_shell >= 0) {
+    ::close(to_shell);
+  }
+  if (from_shell >= 0) {
+    ::close(from_shell);
+  }
+  if (pid > 0) {
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+  }
+#endif
+}
+
+auto ShellCoprocess::run(std::string_view command)
+  -> tl::expected<std::string, std::string> {
+#if !defined(__linux__)
+  return tl::make_unexpected("ShellCoprocess: command line execution only "
+      "supported for linux");
+#else
+  auto lock = std::lock_guard(mutex);
+  // a new sentinel every command, so a command echoing an old one can only
+  // confuse itself
+  auto sentinel = std::string("\n__sim_done_") + std::to_string(pid) + "_"
+    + std::to_string(commands_run++) + "__\n";
+  // the whole command goes over on one line, the shell parses all of it before
+  // running anything so it can't block writing output while we're writing
+  auto line = std::string("( eval ") + shell_quote(command)
+    + " ) </dev/null; printf '%s' '" + sentinel + "'\n";
+  if (!write_all(to_shell, line)) {
+    return tl::make_unexpected("ShellCoprocess: unable to write to the shell");
+  }
+
+  auto output = std::string();
+  auto block = std::array<char, read_block_bytes>();
+  while (!output.ends_with(sentinel)) {
+    auto count = ::read(from_shell, block.data(), block.size());
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return tl::make_unexpected("ShellCoprocess: the shell exited before "
+          "finishing the command");
+    }
+    output.append(block.data(), static_cast<size_t>(count));
+  }
+  output.resize(output.size() - sentinel.size());
+  return output;
+#endif
+}
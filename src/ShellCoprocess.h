@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+// One /bin/sh kept running for the whole run and fed the execute command's
+// pattern space over a pipe, so a line costs the shell's fork of a subshell
+// rather than popen's fork and exec of a whole new shell. Every command is
+// followed by a sentinel the shell prints once the command is done, which is
+// how the end of its output is found.
+//
+// Commands run in a subshell, so cd, exit and variables don't leak into the
+// next line, with stdin from /dev/null since the shell's stdin is the pipe the
+// commands come in on. Unlike popen, which passes our stdin on to them.
+// Linux only, like execute.
+class ShellCoprocess {
+public:
+  static auto spawn() -> tl::expected<std::unique_ptr<ShellCoprocess>, std::string>;
+  ~ShellCoprocess();
+
+  ShellCoprocess(const ShellCoprocess&) = delete;
+  auto operator=(const ShellCoprocess&) -> ShellCoprocess& = delete;
+
+  // Standard output of command, standard error goes to ours
+  auto run(std::string_view command) -> tl::expected<std::string, std::string>;
+
+private:
+  ShellCoprocess() = default;
+
+  int pid = -1;
+  int to_shell = -1;
+  int from_shell = -1;
+  size_t commands_run = 0;
+  std::mutex mutex;
+};
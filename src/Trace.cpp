@@ -0,0 +1,96 @@
+#include "Trace.h"
+
+#include <nlohmann/json.hpp>
+
+// commands kept per cycle, past this they are only counted so a cycle which
+// loops forever can't take the trace with it
+constexpr static auto max_commands_per_cycle = size_t(10000);
+
+auto TraceWriter::open(const std::string& file_name, size_t sample_every,
+    std::chrono::nanoseconds threshold)
+  -> tl::expected<std::unique_ptr<TraceWriter>, std::string> {
+  auto writer = std::unique_ptr<TraceWriter>(new TraceWriter());
+  writer->file.reset(std::fopen(file_name.c_str(), "wb"));
+  if (!writer->file) {
+    return tl::make_unexpected(std::string("unable to open file with name: ")
+        + file_name);
+  }
+  writer->origin = std::chrono::steady_clock::now();
+  writer->sample_every = std::max(sample_every, size_t(1));
+  writer->threshold = static_cast<uint64_t>(threshold.count());
+  std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+      "\"args\":{\"name\":\"sim\"}}", writer->file.get());
+  return writer;
+}
+
+TraceWriter::~TraceWriter() {
+  // nowhere to report errors to at this point, execute closes explicitly
+  (void)(close());
+}
+
+auto TraceWriter::now() const -> uint64_t {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - origin).count());
+}
+
+// Timestamps are in microseconds, keep the nanoseconds as decimals
+auto TraceWriter::event(std::string_view name, std::string_view category,
+    uint64_t start, uint64_t end, std::string_view args) -> std::string {
+  auto result = std::string(",\n{\"name\":")
+    + nlohmann::json(std::string(name)).dump()
+    + ",\"cat\":\"" + std::string(category) + "\",\"ph\":\"X\",\"pid\":1,"
+    "\"tid\":1,\"ts\":" + std::to_string(start / 1000) + "."
+    + std::to_string(1000 + start % 1000).substr(1)
+    + ",\"dur\":" + std::to_string((end - start) / 1000) + "."
+    + std::to_string(1000 + (end - start) % 1000).substr(1);
+  if (!args.empty()) {
+    result += ",\"args\":";
+    result += args;
+  }
+  return result + "}";
+}
+
+auto TraceWriter::span(std::string_view name, std::string_view category,
+    uint64_t start, uint64_t end) -> void {
+  if (file) {
+    std::fputs(event(name, category, start, end, "").c_str(), file.get());
+  }
+}
+
+auto TraceWriter::command(std::string_view name, std::string_view category,
+    size_t index, uint64_t start, uint64_t end) -> void {
+  if (pending_commands == max_commands_per_cycle) {
+    dropped_commands++;
+    return;
+  }
+  pending += event(name, category, start, end,
+      "{\"index\":" + std::to_string(index) + "}");
+  pending_commands++;
+}
+
+auto TraceWriter::end_cycle(uint64_t cycle, uint64_t start, uint64_t end)
+  -> void {
+  if (file && ((cycle - 1) % sample_every == 0 || end - start >= threshold)) {
+    auto args = "{\"cycle\":" + std::to_string(cycle)
+      + ",\"dropped_commands\":" + std::to_string(dropped_commands) + "}";
+    std::fputs(event("cycle", "cycle", start, end, args).c_str(), file.get());
+    std::fputs(pending.c_str(), file.get());
+  }
+  pending.clear();
+  pending_commands = 0;
+  dropped_commands = 0;
+}
+
+auto TraceWriter::close() -> ResultVoid {
+  if (!file) {
+    return {};
+  }
+  std::fputs("\n]}\n", file.get());
+  auto written = !std::ferror(file.get());
+  auto closed = std::fclose(file.release()) == 0 && written;
+  if (!closed) {
+    return tl::make_unexpected("unable to write trace");
+  }
+  return {};
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+#include "OutputPool.h"
+
+// Writes Chrome trace event json (load it in Perfetto or chrome://tracing) as
+// the script runs. Every cycle is a span with the commands run in it nested
+// underneath, but only every sample_every'th cycle and cycles which took at
+// least threshold are kept, so the file stays small on huge inputs while slow
+// lines (a stalled execute, an N looping over the rest of the input) are never
+// left out. Spans for loading the script and flushing output are always kept.
+class TraceWriter {
+public:
+  static auto open(const std::string& file_name, size_t sample_every,
+      std::chrono::nanoseconds threshold)
+    -> tl::expected<std::unique_ptr<TraceWriter>, std::string>;
+  ~TraceWriter();
+
+  TraceWriter(const TraceWriter&) = delete;
+  auto operator=(const TraceWriter&) -> TraceWriter& = delete;
+
+  // nanoseconds since the writer was opened
+  auto now() const -> uint64_t;
+
+  // A span outside of any cycle
+  auto span(std::string_view name, std::string_view category, uint64_t start,
+      uint64_t end) -> void;
+  // Held back until end_cycle decides whether the cycle is kept
+  auto command(std::string_view name, std::string_view category, size_t index,
+      uint64_t start, uint64_t end) -> void;
+  auto end_cycle(uint64_t cycle, uint64_t start, uint64_t end) -> void;
+
+  // Finishes the json, the file isn't loadable before this
+  auto close() -> ResultVoid;
+
+private:
+  TraceWriter() = default;
+  auto event(std::string_view name, std::string_view category, uint64_t start,
+      uint64_t end, std::string_view args) -> std::string;
+
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file{nullptr, std::fclose};
+  std::chrono::steady_clock::time_point origin;
+  size_t sample_every = 1;
+  uint64_t threshold = 0;
+  // the current cycle's commands
+  std::string pending;
+  size_t pending_commands = 0;
+  size_t dropped_commands = 0;
+};
@@ -0,0 +1,54 @@
+#include "Daemon.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+static constexpr auto usage = "usage: sim_client [--socket=PATH] [--optimize] "
+  "input json_script\n"
+  "Runs json_script over input on the sim daemon (sim --serve=PATH) at PATH, "
+  "or $SIM_SOCKET. An input of - is standard input. Options besides these are "
+  "the daemon's own, given to sim --serve.";
+
+int main(int argc, char* argv[]) {
+  const auto* socket_variable = std::getenv("SIM_SOCKET");
+  auto socket_path = std::string(socket_variable ? socket_variable : "");
+  auto optimize = false;
+  auto positional = std::vector<std::string>();
+  for (int i = 1; i < argc; i++) {
+    auto argument = std::string(argv[i]);
+    if (argument.starts_with("--socket=")) {
+      socket_path = argument.substr(std::string("--socket=").size());
+    } else if (argument == "--optimize") {
+      optimize = true;
+    } else if (argument.starts_with("--")) {
+      std::cerr << "sim_client: unknown option: " << argument << "\n" << usage
+        << std::endl;
+      return 2;
+    } else {
+      positional.push_back(argument);
+    }
+  }
+  if (positional.size() != 2 || socket_path.empty()) {
+    std::cerr << usage << std::endl;
+    return 2;
+  }
+
+  auto input_fd = positional[0] == "-"
+    ? STDIN_FILENO
+    : ::open(positional[0].c_str(), O_RDONLY | O_CLOEXEC);
+  if (input_fd < 0) {
+    std::cerr << "sim_client: unable to open file with name: " << positional[0]
+      << std::endl;
+    return 1;
+  }
+  auto ran = run_remote(socket_path, positional[1], input_fd, STDOUT_FILENO,
+      optimize);
+  if (!ran) {
+    std::cerr << "sim_client: " << ran.error() << std::endl;
+    return 1;
+  }
+  return *ran;
+}
@@ -1,12 +1,57 @@
 #include "Context.h"
+#include "Daemon.h"
+#include "Optimizer.h"
 
+#include <csignal>
 #include <iostream>
+#include <unistd.h>
+
+// What SIGINT and SIGTERM stop when serving
+static Daemon* serving = nullptr;
+
+auto stop_serving(int) -> void {
+  if (serving) {
+    serving->stop();
+  }
+}
 
 int main (int argc, char* argv[]) {
-  if (argc != 3) {
-    throw std::runtime_error("sim requires two arguments: input, json script");
+  auto maybe_arguments = parse_arguments(argc, argv);
+  if (!maybe_arguments) {
+    throw std::runtime_error(maybe_arguments.error());
+  }
+  const auto& arguments = maybe_arguments.value();
+  auto text_to_commands = arguments.stream_json ? parse_json_stream : parse_json;
+
+  if (arguments.serve_socket) {
+    auto daemon = Daemon::listen(*arguments.serve_socket, arguments.options,
+        arguments.daemon_workers);
+    if (!daemon) {
+      throw std::runtime_error(daemon.error());
+    }
+    serving = daemon->get();
+    std::signal(SIGINT, stop_serving);
+    std::signal(SIGTERM, stop_serving);
+    serving->serve();
+    return 0;
+  }
+
+  if (arguments.dump_program) {
+    auto maybe_json = file_to_string(arguments.command_file);
+    if (!maybe_json) {
+      throw std::runtime_error(maybe_json.error());
+    }
+    auto maybe_commands = text_to_commands(maybe_json.value());
+    if (!maybe_commands) {
+      throw std::runtime_error(maybe_commands.error());
+    }
+    std::cout << commands_to_json(arguments.options.optimize
+        ? optimize_commands(maybe_commands.value())
+        : maybe_commands.value());
+    return 0;
   }
 
-  std::cout << execute_from_files(argv[1], argv[2]);
-  return 0;
+  return execute_from_files_into(fd_writer(STDOUT_FILENO),
+      *arguments.input_file, arguments.command_file, arguments.options,
+      text_to_commands);
 }
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include "Batch.h"
+
+auto execute_batched(const std::string& input, const std::string& script)
+  -> std::string {
+  auto options = Options();
+  options.batch = true;
+  return execute(input, script, "./test.txt", parse_json, options);
+}
+
+auto batch_lines(size_t count) -> std::string {
+  auto result = std::string();
+  for (size_t i = 0; i < count; i++) {
+    result += "This is line #" + std::to_string(i) + nl;
+  }
+  return result;
+}
+
+TEST(batch, batchable_test_0) {
+  auto commands = parse_json(R"({
+  "s": { "arguments": ["line", "row"] },
+  "d": { "arguments": ["warns on every line"] }
+})").value();
+  ASSERT_FALSE(is_batchable(commands, compile_commands(commands).value()));
+}
+
+TEST(batch, run_batched_test_0) {
+  // more than one batch worth, with a trailing line without a newline
+  auto input = batch_lines(2 * batch_size + 10) + "unterminated";
+  auto script = R"({
+  "F": { },
+  "y": { "arguments": ["is", "IS"] },
+  "s": { "arguments": ["line #([0-9]*)3$", "row $1"] },
+  "T": { "arguments": ["skip"] },
+  "p": { },
+  "i": { "arguments": ["inserted"] },
+  "b": { "arguments": ["end"] },
+  ":": { "arguments": ["skip"] },
+  "l": { },
+  "c": { "arguments": ["changed"] },
+  "label": { "arguments": ["end"] }
+})";
+  ASSERT_EQ(execute(input, script, "./test.txt"), execute_batched(input, script));
+}
+
+TEST(batch, run_batched_test_1) {
+  // backwards jumps mean lines revisit commands that already ran on the batch
+  auto input = batch_lines(100);
+  auto script = R"({
+  ":": { "arguments": ["again"] },
+  "s": { "arguments": ["#[0-9]", "#"] },
+  "t": { "arguments": ["again"] },
+  "d": { },
+  "a": { "arguments": ["never reached"] }
+})";
+  ASSERT_EQ(execute(input, script), execute_batched(input, script));
+  ASSERT_EQ("", execute_batched(input, script));
+}
+
+TEST(batch, run_batched_test_2) {
+  auto input = batch_lines(10);
+  auto script = R"({
+  "s": { "arguments": ["line", "row"] },
+  "t": { "arguments": ["missing"] },
+  "z": { },
+  "a": { "arguments": ["appended"] }
+})";
+  ASSERT_EQ(execute(input, script), execute_batched(input, script));
+}
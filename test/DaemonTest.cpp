@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Context.h"
+#include "Daemon.h"
+#include "TestHelpers.h"
+
+constexpr static auto daemon_script = R"({
+  "s": { "arguments": ["line", "row"] },
+  "=": { }
+})";
+
+// Serves on a thread for the length of a test
+struct ServingDaemon {
+  std::unique_ptr<Daemon> daemon;
+  std::thread thread;
+
+  explicit ServingDaemon(const std::string& socket_path, size_t workers = 2,
+      std::chrono::milliseconds job_timeout = std::chrono::seconds(10))
+    : daemon(Daemon::listen(socket_path, Options(), workers, job_timeout)
+        .value()),
+      thread([this]() { daemon->serve(); }) {}
+
+  ~ServingDaemon() {
+    daemon->stop();
+    thread.join();
+  }
+};
+
+auto write_test_file(const std::string& name, const std::string& contents)
+  -> std::string {
+  std::ofstream(name, std::ios::trunc) << contents;
+  return name;
+}
+
+// Runs a job with the output going to a file, returns what it wrote
+auto run_job(const std::string& socket_path, const std::string& script_file,
+    const std::string& input_file)
+  -> tl::expected<std::string, std::string> {
+  auto output_file = input_file + ".out";
+  auto input_fd = ::open(input_file.c_str(), O_RDONLY);
+  auto output_fd = ::open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+      0644);
+  auto ran = run_remote(socket_path, script_file, input_fd, output_fd, false);
+  ::close(input_fd);
+  ::close(output_fd);
+  if (!ran) {
+    return tl::make_unexpected(ran.error());
+  }
+  return file_to_string(output_file).value();
+}
+
+TEST(daemon, run_remote_test_0) {
+  auto serving = ServingDaemon("daemon_run_remote_test_0.sock");
+  auto script = write_test_file("daemon_run_remote_test_0.json", daemon_script);
+  auto input = write_test_file("daemon_run_remote_test_0.txt", numbered_lines);
+
+  ASSERT_EQ(0, serving.daemon->cached_scripts());
+  ASSERT_EQ(execute(numbered_lines, daemon_script),
+      run_job("daemon_run_remote_test_0.sock", script, input).value());
+  // the second job finds it compiled already
+  ASSERT_EQ(execute(numbered_lines, daemon_script),
+      run_job("daemon_run_remote_test_0.sock", script, input).value());
+  ASSERT_EQ(1, serving.daemon->cached_scripts());
+}
+
+TEST(daemon, concurrent_test_0) {
+  auto serving = ServingDaemon("daemon_concurrent_test_0.sock");
+  auto script = write_test_file("daemon_concurrent_test_0.json", daemon_script);
+  auto clients = std::vector<std::thread>();
+  auto results = std::vector<std::string>(8);
+  for (size_t i = 0; i < results.size(); i++) {
+    clients.emplace_back([&script, &results, i]() {
+      auto input = write_test_file("daemon_concurrent_test_0_"
+          + std::to_string(i) + ".txt", "line " + std::to_string(i) + "\n");
+      results[i] = run_job("daemon_concurrent_test_0.sock", script, input)
+        .value_or("failed");
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    ASSERT_EQ("1\nrow " + std::to_string(i) + "\n", results[i]);
+  }
+}
+
+TEST(daemon, error_test_0) {
+  auto serving = ServingDaemon("daemon_error_test_0.sock");
+  auto script = write_test_file("daemon_error_test_0.json",
+      R"({ "nope": { } })");
+  auto input = write_test_file("daemon_error_test_0.txt", numbered_lines);
+  ASSERT_EQ("Engine: unable to load script: compile_commands: no command with "
+      "name: nope", run_job("daemon_error_test_0.sock", script, input).error());
+  ASSERT_FALSE(run_job("daemon_error_test_0_missing.sock", script, input));
+}
+
+TEST(daemon, quit_test_0) {
+  // the exit code q gives comes back to the client
+  auto serving = ServingDaemon("daemon_quit_test_0.sock");
+  auto script = write_test_file("daemon_quit_test_0.json",
+      R"({ "q": { "address": 1, "arguments": ["5"] } })");
+  auto input = write_test_file("daemon_quit_test_0.txt", numbered_lines);
+  auto input_fd = ::open(input.c_str(), O_RDONLY);
+  auto output_fd = ::open("daemon_quit_test_0.txt.out",
+      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  auto ran = run_remote("daemon_quit_test_0.sock", script, input_fd, output_fd,
+      false);
+  ::close(input_fd);
+  ::close(output_fd);
+  ASSERT_EQ(5, ran.value());
+  ASSERT_EQ("This is line #1\n",
+      file_to_string("daemon_quit_test_0.txt.out").value());
+}
+
+TEST(daemon, idle_client_test_0) {
+  // a client which connects and sends nothing only holds the one worker
+  // until the job timeout
+  auto serving = ServingDaemon("daemon_idle_client_test_0.sock", 1,
+      std::chrono::milliseconds(100));
+  auto address = sockaddr_un();
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, "daemon_idle_client_test_0.sock");
+  auto idle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(0, ::connect(idle, reinterpret_cast<sockaddr*>(&address),
+        sizeof(address)));
+
+  auto script = write_test_file("daemon_idle_client_test_0.json",
+      daemon_script);
+  auto input = write_test_file("daemon_idle_client_test_0.txt", numbered_lines);
+  ASSERT_EQ(execute(numbered_lines, daemon_script),
+      run_job("daemon_idle_client_test_0.sock", script, input).value());
+  ::close(idle);
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "Context.h"
+#include "Engine.h"
+
+constexpr static auto engine_script = R"({
+  "s": { "arguments": ["line", "row"] },
+  "h": { },
+  "=": { "address": 2 }
+})";
+
+TEST(engine, run_test_0) {
+  auto engine = Engine::compile(engine_script).value();
+  for (auto input : {"This is line #1\nThis is line #2\n", "", "line\n",
+      "one\ntwo\nthree\n"}) {
+    ASSERT_EQ(execute(input, engine_script), engine.run(input).value());
+    auto sunk = std::string();
+    ASSERT_TRUE(engine.run(input, [&sunk](std::string_view output) {
+      sunk += output;
+    }));
+    ASSERT_EQ(execute(input, engine_script), sunk);
+  }
+}
+
+TEST(engine, threads_test_0) {
+  // every run has its own state, line numbers start over each time
+  auto engine = Engine::compile(engine_script).value();
+  auto results = std::vector<std::string>(8);
+  auto workers = std::vector<std::thread>();
+  for (size_t i = 0; i < results.size(); i++) {
+    workers.emplace_back([&engine, &results, i]() {
+      for (int run = 0; run < 100; run++) {
+        results[i] = engine.run("line " + std::to_string(i) + "\nnext\n").value();
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (size_t i = 0; i < results.size(); i++) {
+    ASSERT_EQ("row " + std::to_string(i) + "\n2\nnext\n", results[i]);
+  }
+}
+
+TEST(engine, error_test_0) {
+  auto not_json = Engine::compile("{ \"s\": ");
+  ASSERT_FALSE(not_json);
+  ASSERT_TRUE(not_json.error().starts_with("Engine: unable to parse json: "));
+  ASSERT_EQ("Engine: unable to load script: compile_commands: no command with "
+      "name: nope", Engine::compile(R"({ "nope": { } })").error());
+
+  auto engine = Engine::compile(R"({ "s": { "arguments": ["one"] } })").value();
+  ASSERT_EQ("Engine: execute: unable to execute command: substitute_function: "
+      "substitute expects 2 argument", engine.run("one\n").error());
+}
+
+TEST(engine, options_test_0) {
+  auto options = Options();
+  options.optimize = true;
+  auto engine = Engine::compile(R"({
+  "b": { "arguments": ["end"] },
+  "p": { },
+  ":": { "arguments": ["end"] }
+})", options).value();
+  ASSERT_EQ(0, engine.commands().size());
+  ASSERT_EQ("a\nb\n", engine.run("a\nb\n").value());
+}
+
+TEST(engine, quit_test_0) {
+  auto engine = Engine::compile(R"({
+  "q": { "address": 2, "arguments": ["5"] }
+})").value();
+  auto sunk = std::string();
+  ASSERT_EQ(5, engine.run("a\nb\nc\n", [&sunk](std::string_view output) {
+    sunk += output;
+  }).value());
+  ASSERT_EQ("a\nb\n", sunk);
+  ASSERT_EQ(0, engine.run("a\n", [](std::string_view) { }).value());
+}
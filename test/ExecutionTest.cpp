@@ -1,7 +1,9 @@
+#include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
 
 #include "Context.h"
+#include "FileCache.h"
 #include "Version.h"
 
 constexpr static auto line_one_through_five = R"(This is line #1
@@ -296,6 +298,32 @@ This is line #6
 #endif
 }
 
+TEST(execution, execute_test_2) {
+#if defined(__linux__)
+  // the coprocess has to frame output exactly like popen, including quotes,
+  // missing trailing newlines and commands which try to leave state behind
+  auto input = R"sh(echo 'single quoted'
+printf "no newline"
+cd /; X=1; exit 3
+echo "[$X]"; [ "$(pwd)" = / ] && echo leaked
+true
+)sh";
+  auto script = R"({
+  "e": {}
+})";
+  auto options = Options();
+  options.exec_backend = ExecBackend::coprocess;
+
+  testing::internal::CaptureStderr();
+  auto expected_output = execute(input, script);
+  auto result = execute(input, script, std::nullopt, parse_json, options);
+  testing::internal::GetCapturedStderr();
+
+  ASSERT_EQ(expected_output, result);
+  ASSERT_EQ("single quoted\n\nno newline\n\n[]\n\n\n", result);
+#endif
+}
+
 TEST(execution, prepend_file_name_0) {
   auto result = execute(line_one_through_five, R"({
   "F": {}
@@ -718,6 +746,116 @@ This is line #5
   ASSERT_EQ(result, expected_output);
 }
 
+TEST(execution, quit_test_0) {
+  auto result = execute(line_one_through_five, R"({
+  "q": {
+    "address": 2
+  }
+})");
+
+  auto expected_output = R"(This is line #1
+This is line #2
+)";
+
+  ASSERT_EQ(result, expected_output);
+}
+
+TEST(execution, quit_test_1) {
+  // the output made before quitting comes out, then the exit code
+  auto result = std::string();
+  auto exit_code = execute_into([&result](auto pieces) {
+    for (auto piece : pieces) {
+      result += piece;
+    }
+    return true;
+  }, line_one_through_five, R"({
+  "p": { },
+  "q": {
+    "address": 2,
+    "arguments": ["3"]
+  }
+})");
+
+  auto expected_output = R"(This is line #1
+This is line #1
+This is line #2
+This is line #2
+)";
+
+  ASSERT_EQ(result, expected_output);
+  ASSERT_EQ(exit_code, 3);
+}
+
+TEST(execution, quit_test_2) {
+  // We want to be able to run this over and over without having to remove the
+  // file, this clears it each run
+  std::ofstream clean_out_file("quit_test_2.txt", std::ios::trunc);
+  clean_out_file.close();
+
+  auto result = execute(line_one_through_five, R"({
+  "w": {
+    "arguments": ["quit_test_2.txt"]
+  },
+  "q": {
+    "address": 3
+  }
+})");
+
+  auto written = file_to_string("quit_test_2.txt");
+  ASSERT_TRUE(written);
+
+  ASSERT_EQ(result, written.value());
+}
+
+TEST(execution, quit_test_3) {
+  ASSERT_THROW(execute(line_one_through_five, R"({
+  "q": {
+    "arguments": ["three"]
+  }
+})"), std::runtime_error);
+}
+
+TEST(execution, quit_test_4) {
+  // main returns the exit code, which the shell only sees the low byte of
+  ASSERT_THROW(execute(line_one_through_five, R"({
+  "q": {
+    "arguments": ["256"]
+  }
+})"), std::runtime_error);
+}
+
+TEST(execution, quit_silent_test_0) {
+  auto result = execute(line_one_through_five, R"({
+  "Q": {
+    "address": 2
+  }
+})");
+
+  auto expected_output = R"(This is line #1
+)";
+
+  ASSERT_EQ(result, expected_output);
+}
+
+TEST(execution, quit_silent_test_1) {
+  // the cycle ends at Q, nothing after it runs
+  auto result = std::string();
+  auto exit_code = execute_into([&result](auto pieces) {
+    for (auto piece : pieces) {
+      result += piece;
+    }
+    return true;
+  }, line_one_through_five, R"({
+  "Q": {
+    "arguments": ["0"]
+  },
+  "p": { }
+})");
+
+  ASSERT_EQ(result, "");
+  ASSERT_EQ(exit_code, 0);
+}
+
 TEST(execution, read_in_file_test_0) {
   auto result = execute(line_one_through_five, R"({
     "r": {
@@ -1307,6 +1445,25 @@ The is line #5
   ASSERT_EQ(result, expected_output);
 }
 
+TEST(execution, translation_test_3) {
+  // the replacement contains what is being replaced, which is not searched
+  // again
+  auto result = execute(line_one_through_five, R"({
+  "y": {
+    "arguments": ["is", "isis"]
+  }
+})");
+
+  auto expected_output = R"(Thisis isis line #1
+Thisis isis line #2
+Thisis isis line #3
+Thisis isis line #4
+Thisis isis line #5
+)";
+
+  ASSERT_EQ(result, expected_output);
+}
+
 TEST(execution, zap_test_0) {
   auto result = execute(line_one_through_five, R"({
   "z": { }
@@ -1437,3 +1594,168 @@ TEST(execution, verify_label_test_2) {
     FAIL() << "Expected std::runtime_error";
   }
 }
+
+TEST(execution, unknown_command_test_0) {
+  // unknown names are rejected when the script is loaded, even if no line is
+  // ever processed
+  try {
+    auto result = execute("", R"({ "not_a_command": { } })");
+    FAIL() << "Expected std::runtime_error";
+  } catch (const std::runtime_error& e) {
+    EXPECT_STREQ("execute: unable to load script: compile_commands: no command "
+        "with name: not_a_command", e.what());
+  }
+}
+
+auto shout_function(Context context, const Command& command) -> ResultContext {
+  (void)(command);
+  for (auto& c : *context.operations_stream) {
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  }
+  return context;
+}
+
+TEST(execution, register_command_test_0) {
+  ASSERT_FALSE(register_command("s", shout_function));
+  register_command("shout", shout_function);
+  ASSERT_FALSE(register_command("shout", shout_function));
+
+  auto result = execute(line_one_through_five, R"({
+  "shout": { }
+})");
+
+  auto expected_output = R"(THIS IS LINE #1
+THIS IS LINE #2
+THIS IS LINE #3
+THIS IS LINE #4
+THIS IS LINE #5
+)";
+
+  ASSERT_EQ(result, expected_output);
+}
+
+TEST(execution, nl_append_to_file_test_2) {
+  std::ofstream clean_out_file("nl_append_to_file_test_2.txt", std::ios::trunc);
+  clean_out_file.close();
+
+  auto result = execute(line_one_through_five, R"({
+  "N": { },
+  "W": {
+    "arguments": ["nl_append_to_file_test_2.txt"]
+  }
+})");
+
+  auto expected_output = file_to_string("nl_append_to_file_test_2.txt");
+  ASSERT_TRUE(expected_output);
+  ASSERT_EQ(R"(This is line #1
+This is line #3
+)", expected_output.value());
+}
+
+TEST(execution, append_to_file_test_2) {
+  // several files with buffers small enough to go through the write behind
+  // thread many times over
+  for (auto name : {"append_to_file_test_2_odd.txt",
+      "append_to_file_test_2_all.txt"}) {
+    std::ofstream clean_out_file(name, std::ios::trunc);
+  }
+
+  auto options = Options();
+  options.write_behind = true;
+  options.output_buffer_bytes = 16;
+  auto input = std::string();
+  for (int i = 0; i < 200; i++) {
+    input += std::to_string(i) + nl;
+  }
+  auto result = execute(input, R"({
+  "w": {
+    "arguments": ["append_to_file_test_2_all.txt"]
+  },
+  "s": {
+    "arguments": ["^[0-9]*[02468]$", ""]
+  },
+  "t": {
+    "arguments": ["end"]
+  },
+  "W": {
+    "arguments": ["append_to_file_test_2_odd.txt"]
+  },
+  ":": {
+    "arguments": ["end"]
+  }
+})", std::nullopt, parse_json, options);
+
+  auto expected_odd = std::string();
+  for (int i = 1; i < 200; i += 2) {
+    expected_odd += std::to_string(i) + nl;
+  }
+  ASSERT_EQ(input, file_to_string("append_to_file_test_2_all.txt").value());
+  ASSERT_EQ(expected_odd, file_to_string("append_to_file_test_2_odd.txt").value());
+}
+
+TEST(execution, read_in_file_test_2) {
+  // the file grows every line, which revalidate picks up, snapshot keeps the
+  // empty file it saw when the script was loaded
+  auto script = R"({
+  "w": {
+    "arguments": ["read_in_file_test_2.txt"]
+  },
+  "r": {
+    "arguments": ["read_in_file_test_2.txt"]
+  }
+})";
+  auto input = "one\ntwo\n";
+  auto options = Options();
+  options.flush_policy = FlushPolicy::every_write;
+
+  std::ofstream("read_in_file_test_2.txt", std::ios::trunc).close();
+  ASSERT_EQ("one\none\ntwo\none\ntwo\n",
+      execute(input, script, std::nullopt, parse_json, options));
+
+  std::ofstream("read_in_file_test_2.txt", std::ios::trunc).close();
+  options.read_policy = ReadPolicy::snapshot;
+  ASSERT_EQ("one\n\ntwo\n\n",
+      execute(input, script, std::nullopt, parse_json, options));
+}
+
+TEST(execution, read_in_file_test_3) {
+  try {
+    auto result = execute(line_one_through_five, R"({
+    "r": {
+      "arguments": ["../resources/does_not_exist.txt"]
+    }
+})");
+    FAIL() << "Expected std::runtime_error";
+  } catch (const std::runtime_error& e) {
+    EXPECT_STREQ("execute: unable to load script: open_handles: r: "
+        "unable to open file with name: ../resources/does_not_exist.txt", e.what());
+  }
+}
+
+TEST(execution, read_in_file_test_4) {
+  // files are opened when the script loads, even if no input reaches them
+  try {
+    auto result = execute("", R"({
+    "R": {
+      "arguments": ["../resources/does_not_exist.txt"]
+    }
+})");
+    FAIL() << "Expected std::runtime_error";
+  } catch (const std::runtime_error& e) {
+    EXPECT_STREQ("execute: unable to load script: open_handles: R: "
+        "unable to open file with name: ../resources/does_not_exist.txt", e.what());
+  }
+}
+
+TEST(execution, read_in_file_test_5) {
+  // a snapshot is a copy, writing over the file in place or truncating it
+  // doesn't reach it
+  std::ofstream("read_in_file_test_5.txt", std::ios::trunc) << "before\n";
+  auto cache = FileCache(ReadPolicy::snapshot);
+  auto slot = cache.open("read_in_file_test_5.txt").value();
+  std::fstream("read_in_file_test_5.txt", std::ios::in | std::ios::out)
+    << "AFTER!";
+  ASSERT_EQ("before", cache.get(slot).value());
+  std::filesystem::resize_file("read_in_file_test_5.txt", 0);
+  ASSERT_EQ("before", cache.get(slot).value());
+}
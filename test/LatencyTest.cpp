@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "Context.h"
+#include "Latency.h"
+#include "TestHelpers.h"
+
+TEST(latency, bucket_test_0) {
+  // exact below 256, within 1/128th above
+  for (uint64_t value : {uint64_t(0), uint64_t(1), uint64_t(255), uint64_t(256),
+      uint64_t(1000), uint64_t(123456789), uint64_t(1) << 40,
+      ~uint64_t(0)}) {
+    auto bucket = LatencyHistogram::bucket(value);
+    auto top = LatencyHistogram::bucket_top(bucket);
+    ASSERT_GE(top, value);
+    ASSERT_LE(top - value, value / 128) << value;
+    if (bucket > 0) {
+      ASSERT_LT(LatencyHistogram::bucket_top(bucket - 1), value) << value;
+    }
+  }
+}
+
+TEST(latency, percentile_test_0) {
+  auto histogram = LatencyHistogram();
+  ASSERT_EQ(0, histogram.percentile(0.5));
+  for (uint64_t i = 1; i <= 1000; i++) {
+    histogram.record(i * 1000);
+  }
+  ASSERT_EQ(1000, histogram.count());
+  ASSERT_EQ(1000000, histogram.max());
+  ASSERT_EQ(1000000, histogram.percentile(1.0));
+  for (auto [fraction, value] : {std::pair(0.5, 500000.0),
+      std::pair(0.99, 990000.0), std::pair(0.999, 999000.0)}) {
+    auto percentile = static_cast<double>(histogram.percentile(fraction));
+    ASSERT_GE(percentile, value);
+    ASSERT_LE(percentile, value * (1 + 1.0 / 128));
+  }
+}
+
+TEST(latency, slow_lines_test_0) {
+  auto stats = LatencyStats(3);
+  for (uint64_t cycle = 1; cycle <= 100; cycle++) {
+    stats.record(SlowLine{cycle, cycle, (cycle * 37) % 101, 0, 0});
+  }
+  auto slowest = stats.slowest();
+  ASSERT_EQ(3, slowest.size());
+  ASSERT_EQ(100, slowest[0].nanoseconds);
+  ASSERT_EQ(99, slowest[1].nanoseconds);
+  ASSERT_EQ(98, slowest[2].nanoseconds);
+  ASSERT_EQ(100, stats.histogram.count());
+}
+
+TEST(latency, run_instrumented_test_0) {
+  // e running the sleep makes line 3 the slowest by far, and e the costliest
+  // command on it
+  constexpr auto input = "echo one\necho two\nsleep 0.05; echo three\n"
+    "echo four\n";
+  auto stats = LatencyStats(2);
+  run_instrumented(loaded_context(input, R"({
+  "s": { "arguments": ["one", "1"] },
+  "e": { "address": 3 }
+})"), nullptr, nullptr, nullptr, 0, &stats);
+
+  ASSERT_EQ(4, stats.histogram.count());
+  auto slowest = stats.slowest();
+  ASSERT_EQ(2, slowest.size());
+  ASSERT_EQ(3, slowest[0].cycle);
+  ASSERT_EQ(std::string("sleep 0.05; echo three").size(), slowest[0].input_bytes);
+  ASSERT_EQ(1, slowest[0].command);
+  ASSERT_GE(slowest[0].nanoseconds, 50000000);
+  ASSERT_GE(slowest[0].nanoseconds, slowest[0].command_nanoseconds);
+  ASSERT_GE(stats.histogram.max(), 50000000);
+  ASSERT_LT(stats.histogram.percentile(0.5), 50000000);
+}
+
+auto nap_function(Context context, const Command&) -> ResultContext {
+  std::this_thread::sleep_for(std::chrono::milliseconds(3));
+  return context;
+}
+
+auto doze_function(Context context, const Command&) -> ResultContext {
+  std::this_thread::sleep_for(std::chrono::milliseconds(8));
+  return context;
+}
+
+TEST(latency, run_instrumented_test_1) {
+  // nap runs six times in the loop, 18ms in all, so it's the costliest
+  // command of the line even though doze takes longer at once
+  register_command("nap", nap_function);
+  register_command("doze", doze_function);
+  auto stats = LatencyStats(1);
+  run_instrumented(loaded_context("xxxxx\n", R"({
+  ":": { "arguments": ["loop"] },
+  "nap": { },
+  "s": { "arguments": ["x$", ""] },
+  "t": { "arguments": ["loop"] },
+  "doze": { }
+})"), nullptr, nullptr, nullptr, 0, &stats);
+
+  auto slowest = stats.slowest();
+  ASSERT_EQ(1, slowest.size());
+  ASSERT_EQ(1, slowest[0].command);
+  ASSERT_GE(slowest[0].command_nanoseconds, 18000000);
+  ASSERT_GE(slowest[0].nanoseconds, slowest[0].command_nanoseconds);
+}
@@ -0,0 +1,40 @@
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "Context.h"
+#include "LineReader.h"
+
+TEST(line_reader, find_delimiter_test_0) {
+  ASSERT_EQ(3, find_delimiter("abc\r\ndef", "\r\n"));
+  ASSERT_EQ(5, find_delimiter("a\rb\rc\r\n", "\r\n"));
+  ASSERT_EQ(std::string_view::npos, find_delimiter("abc\r", "\r\n"));
+  ASSERT_EQ(3, find_delimiter("a\nb\nc", "\n", 2));
+}
+
+TEST(line_reader, next_line_test_0) {
+  // lines longer than a block and a last line without a newline
+  auto long_line = std::string(200000, 'x');
+  {
+    std::ofstream file("line_reader_test_0.txt", std::ios::trunc);
+    file << "first" << nl << nl << long_line << nl << "last";
+  }
+
+  auto reader = LineReader("line_reader_test_0.txt", nl);
+  auto expected = std::vector<std::string>{"first", "", long_line, "last"};
+  for (const auto& line : expected) {
+    auto next = reader.next_line();
+    ASSERT_TRUE(next && *next);
+    ASSERT_EQ(line, **next);
+  }
+  auto done = reader.next_line();
+  ASSERT_TRUE(done);
+  ASSERT_FALSE(*done);
+}
+
+TEST(line_reader, next_line_test_1) {
+  auto reader = LineReader("../resources/does_not_exist.txt", nl);
+  auto next = reader.next_line();
+  ASSERT_FALSE(next);
+  ASSERT_EQ("unable to open file with name: ../resources/does_not_exist.txt",
+      next.error());
+}
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+
+#include "Context.h"
+#include "MemoryStats.h"
+#include "TestHelpers.h"
+
+TEST(memory_stats, hold_space_test_0) {
+  auto input = std::string();
+  for (int i = 0; i < 100; i++) {
+    input += std::string(100, 'a') + nl;
+  }
+  auto memory = MemoryStats();
+  run_instrumented(loaded_context(input, R"({ "H": { } })"), nullptr, nullptr,
+      &memory);
+
+  // every line is held on to, with a newline in front of it
+  ASSERT_GE(memory.hold_space.peak, 100 * 101);
+  ASSERT_EQ(memory.hold_space.peak, memory.hold_space.current);
+  ASSERT_LT(memory.pattern_space.peak, 200);
+  ASSERT_GE(memory.result.current, input.size());
+}
+
+TEST(memory_stats, pattern_space_test_0) {
+  // z empties the pattern space at the end of every line, the peak still
+  // remembers how big N made it
+  auto memory = MemoryStats();
+  run_instrumented(loaded_context("a\nb\nc\nd\n", R"({
+  "N": { },
+  "z": { }
+})"), nullptr, nullptr, &memory);
+
+  ASSERT_GE(memory.pattern_space.peak, std::string("a\nb").size());
+}
+
+TEST(memory_stats, report_test_0) {
+  // the tests don't link AllocationCounter.cpp
+  auto stats = MemoryStats();
+  stats.hold_space.set(10);
+  stats.hold_space.set(4);
+  auto report = memory_report(stats);
+
+  ASSERT_NE(std::string::npos, report.find("hold space: 4 bytes, peak 10 bytes"));
+  ASSERT_NE(std::string::npos, report.find("heap: not counted"));
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include "Context.h"
+#include "Optimizer.h"
+#include "TestHelpers.h"
+
+// parse_json can't hold the same key twice, so feed Commands in directly
+auto run_commands(const Commands& commands, bool optimize) -> std::string {
+  auto options = Options();
+  options.optimize = optimize;
+  return execute(numbered_lines, "", std::nullopt,
+      [&commands](const std::string&) -> ResultCommands { return commands; },
+      options);
+}
+
+TEST(optimizer, unreachable_test_0) {
+  auto commands = Commands{
+    Command("b", Strings{"end"}, std::nullopt),
+    Command("p", std::nullopt, std::nullopt),
+    Command("d", std::nullopt, std::nullopt),
+    Command(":", Strings{"end"}, std::nullopt),
+    Command("=", std::nullopt, std::nullopt),
+  };
+
+  auto optimized = optimize_commands(commands);
+  ASSERT_EQ(Commands{Command("=", std::nullopt, std::nullopt)}, optimized);
+  ASSERT_EQ(run_commands(commands, false), run_commands(commands, true));
+}
+
+TEST(optimizer, jump_threading_test_0) {
+  auto commands = Commands{
+    Command("s", Strings{"line", "row"}, std::nullopt),
+    Command("t", Strings{"first"}, std::nullopt),
+    Command("p", std::nullopt, std::nullopt),
+    Command(":", Strings{"first"}, std::nullopt),
+    Command(":", Strings{"chained"}, std::nullopt),
+    Command("b", Strings{"second"}, std::nullopt),
+    Command("d", std::nullopt, std::nullopt),
+    Command(":", Strings{"second"}, std::nullopt),
+    Command("=", std::nullopt, std::nullopt),
+  };
+
+  auto optimized = optimize_commands(commands);
+  ASSERT_EQ(Command("t", Strings{"second"}, std::nullopt), optimized[1]);
+  ASSERT_EQ(run_commands(commands, false), run_commands(commands, true));
+}
+
+TEST(optimizer, label_chain_test_0) {
+  auto commands = Commands{
+    Command("b", Strings{"second"}, 2),
+    Command("p", std::nullopt, std::nullopt),
+    Command(":", Strings{"first"}, std::nullopt),
+    Command(":", Strings{"second"}, std::nullopt),
+    Command("=", std::nullopt, std::nullopt),
+    Command("b", Strings{"first"}, 3),
+  };
+
+  auto optimized = optimize_commands(commands);
+  ASSERT_EQ((Commands{
+    Command("b", Strings{"first"}, 2),
+    Command("p", std::nullopt, std::nullopt),
+    Command(":", Strings{"first"}, std::nullopt),
+    Command("=", std::nullopt, std::nullopt),
+    Command("b", Strings{"first"}, 3),
+  }), optimized);
+}
+
+TEST(optimizer, merge_test_0) {
+  auto commands = Commands{
+    Command("a", Strings{"one"}, std::nullopt),
+    Command("append", Strings{"two"}, std::nullopt),
+    Command("i", Strings{"three"}, 2),
+    Command("i", Strings{"four"}, 2),
+    Command("a", Strings{"five"}, 2),
+  };
+
+  auto optimized = optimize_commands(commands);
+  ASSERT_EQ((Commands{
+    Command("a", Strings{std::string("one") + nl + "two"}, std::nullopt),
+    Command("i", Strings{std::string("four") + nl + "three"}, 2),
+    Command("a", Strings{"five"}, 2),
+  }), optimized);
+  ASSERT_EQ(run_commands(commands, false), run_commands(commands, true));
+}
+
+TEST(optimizer, dead_write_test_0) {
+  auto commands = Commands{
+    Command("z", std::nullopt, std::nullopt),
+    Command("c", Strings{"changed"}, std::nullopt),
+    Command("c", Strings{"only line two"}, 2),
+    Command("z", std::nullopt, 3),
+  };
+
+  auto optimized = optimize_commands(commands);
+  ASSERT_EQ((Commands{
+    Command("c", Strings{"changed"}, std::nullopt),
+    Command("c", Strings{"only line two"}, 2),
+    Command("z", std::nullopt, 3),
+  }), optimized);
+  ASSERT_EQ(run_commands(commands, false), run_commands(commands, true));
+}
+
+TEST(optimizer, delete_restart_test_0) {
+  // delete_restart jumps back into the script, so nothing is touched
+  auto commands = Commands{
+    Command("b", Strings{"end"}, std::nullopt),
+    Command("p", std::nullopt, std::nullopt),
+    Command(":", Strings{"end"}, std::nullopt),
+    Command("D", std::nullopt, std::nullopt),
+  };
+
+  ASSERT_EQ(commands, optimize_commands(commands));
+}
+
+TEST(optimizer, dump_test_0) {
+  auto commands = Commands{
+    Command("a", Strings{"one"}, std::nullopt),
+    Command("a", Strings{"two"}, 2),
+    Command("d", std::nullopt, std::nullopt),
+  };
+
+  ASSERT_EQ(R"({
+  "a": {"arguments":["one"]},
+  "a": {"address":2,"arguments":["two"]},
+  "d": {}
+}
+)", commands_to_json(commands));
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <unistd.h>
+
+#include "Context.h"
+#include "Output.h"
+#include "TestHelpers.h"
+
+// The pieces execute_into writes, and the segments behind them
+auto run_into(const std::string& input, const std::string& script,
+    const Options& options = Options()) -> std::vector<std::string> {
+  auto pieces = std::vector<std::string>();
+  execute_into([&pieces](std::span<const std::string_view> written) {
+    pieces.insert(pieces.end(), written.begin(), written.end());
+    return true;
+  }, input, script, std::nullopt, parse_json, options);
+  return pieces;
+}
+
+auto joined(const std::vector<std::string>& pieces) -> std::string {
+  auto output = std::string();
+  for (const auto& piece : pieces) {
+    output += piece;
+  }
+  return output;
+}
+
+TEST(output, parity_test_0) {
+  for (auto script : {
+      R"({ "=": { } })",
+      R"({ "s": { "arguments": ["#2", "two"] } })",
+      R"({ "p": { "address": 3 } })",
+      R"({ "d": { "address": 2 } })",
+      R"({ "n": { } })",
+      R"({ "N": { } })",
+      R"({ "N": { }, "s": { "arguments": ["\n", " "] } })",
+      R"({ "h": { }, "G": { } })",
+      R"({ "a": { "arguments": ["after"] }, "i": { "arguments": ["before"] } })",
+      R"({ "s": { "arguments": ["line #3", "line #3"] } })"}) {
+    ASSERT_EQ(execute(numbered_lines, script), joined(run_into(numbered_lines,
+            script))) << script;
+  }
+}
+
+TEST(output, parity_test_1) {
+  // the runners which build the whole result write it as one piece
+  auto options = Options();
+  options.batch = true;
+  auto script = R"({ "s": { "arguments": ["line", "row"] } })";
+  ASSERT_EQ(std::vector<std::string>{execute(numbered_lines, script)},
+      run_into(numbered_lines, script, options));
+  options.batch = false;
+  options.latency = true;
+  ASSERT_EQ(std::vector<std::string>{execute(numbered_lines, script)},
+      run_into(numbered_lines, script, options));
+}
+
+TEST(output, untouched_test_0) {
+  // every line comes out as it went in, one segment covers all of them
+  ASSERT_EQ(std::vector<std::string>{numbered_lines},
+      run_into(numbered_lines,
+        R"({ "s": { "arguments": ["missing", "x"] } })"));
+}
+
+TEST(output, untouched_test_1) {
+  // the changed line is copied, the untouched runs either side are not
+  ASSERT_EQ((std::vector<std::string>{
+    "This is line #1\n",
+    "This is row #2\n",
+    "This is line #3\nThis is line #4\n"
+  }), run_into(numbered_lines,
+      R"({ "s": { "arguments": ["line", "row"], "address": 2 } })"));
+}
+
+TEST(output, untouched_test_2) {
+  // N joins two lines which are still what was read, so they go out as is
+  ASSERT_EQ(std::vector<std::string>{numbered_lines},
+      run_into(numbered_lines, R"({ "N": { } })"));
+}
+
+TEST(output, pieces_test_0) {
+  auto input = std::string("abcdef");
+  auto result = std::string("XY");
+  auto segments = OutputSegments{{0, 0, 2}, {1, 4, 2}};
+  ASSERT_EQ((std::vector<std::string_view>{"ab", "X", "ef", "Y"}),
+      output_pieces(input, result, segments));
+  ASSERT_EQ(std::vector<std::string_view>{"XY"},
+      output_pieces(input, result, OutputSegments()));
+}
+
+TEST(output, fd_writer_test_0) {
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  auto pieces = std::vector<std::string_view>{"one ", "", "two ", "three"};
+  ASSERT_TRUE(fd_writer(fds[1])(pieces));
+  ::close(fds[1]);
+  auto written = std::string(64, '\0');
+  written.resize(static_cast<size_t>(::read(fds[0], written.data(),
+          written.size())));
+  ::close(fds[0]);
+  ASSERT_EQ("one two three", written);
+}
+
+TEST(output, fd_writer_test_1) {
+  // the reader is gone, the write fails rather than killing us with SIGPIPE
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  ::close(fds[0]);
+  auto pieces = std::vector<std::string_view>{"lost"};
+  ASSERT_FALSE(fd_writer(fds[1])(pieces));
+  ::close(fds[1]);
+}
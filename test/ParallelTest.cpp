@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include "Context.h"
+#include "Parallel.h"
+
+static auto compile_json(const std::string& json)
+  -> std::pair<Commands, Program> {
+  auto commands = parse_json(json);
+  auto program = compile_commands(commands.value());
+  return std::make_pair(commands.value(), program.value());
+}
+
+static auto parallel_lines(size_t count) -> std::string {
+  auto result = std::string();
+  for (size_t i = 0; i < count; i++) {
+    result += "This is line #" + std::to_string(i) + nl;
+  }
+  return result;
+}
+
+TEST(parallel, line_local_test_0) {
+  auto [commands, program] = compile_json(R"({
+  "s": { "arguments": ["line", "row"] },
+  "t": { "arguments": ["done"] },
+  "y": { "arguments": ["is", "IS"] },
+  ":": { "arguments": ["done"] },
+  "p": { }
+})");
+  ASSERT_TRUE(is_line_local(commands, program));
+}
+
+TEST(parallel, line_local_test_1) {
+  for (auto json : {R"({ "h": { } })", R"({ "N": { } })",
+      R"({ "p": { "address": 3 } })", R"({ "=": { } })",
+      R"({ "w": { "arguments": ["file.txt"] } })", R"({ "e": { } })"}) {
+    auto [commands, program] = compile_json(json);
+    ASSERT_FALSE(is_line_local(commands, program)) << json;
+  }
+}
+
+TEST(parallel, execute_parallel_test_0) {
+  // the last line has no newline, so like the serial loop it is dropped
+  auto input = parallel_lines(1000) + "unterminated";
+  auto script = R"({
+  "s": { "arguments": ["line #([0-9]*)7", "row $1"] },
+  "t": { "arguments": ["keep"] },
+  "d": { },
+  ":": { "arguments": ["keep"] },
+  "a": { "arguments": ["appended"] }
+})";
+
+  auto options = Options();
+  options.threads = 4;
+  options.parallel_min_bytes = 1;
+  ASSERT_EQ(execute(input, script), execute(input, script, std::nullopt,
+        parse_json, options));
+}
+
+TEST(parallel, exec_local_test_0) {
+  auto [commands, program] = compile_json(R"({
+  "s": { "arguments": ["^", "echo "] },
+  "e": { },
+  "p": { }
+})");
+  ASSERT_FALSE(is_line_local(commands, program));
+  ASSERT_TRUE(is_exec_local(commands, program));
+
+  for (auto json : {R"({ "p": { } })", R"({ "e": { "address": 2 } })",
+      R"({ "e": { }, "h": { } })"}) {
+    auto [commands, program] = compile_json(json);
+    ASSERT_FALSE(is_exec_local(commands, program)) << json;
+  }
+}
+
+TEST(parallel, execute_exec_pool_test_0) {
+#if defined(__linux__)
+  // later lines finish first, the output still has to come back in order
+  auto input = std::string();
+  for (size_t i = 0; i < 64; i++) {
+    input += "sleep 0.0" + std::to_string((64 - i) % 4) + "; echo "
+      + std::to_string(i) + nl;
+  }
+  auto script = R"({
+  "e": { },
+  "s": { "arguments": ["^", "ran "] }
+})";
+
+  testing::internal::CaptureStderr();
+  auto expected = execute(input, script);
+  for (auto backend : {ExecBackend::popen, ExecBackend::coprocess}) {
+    auto options = Options();
+    options.exec_backend = backend;
+    options.exec_jobs = 8;
+    ASSERT_EQ(expected, execute(input, script, std::nullopt, parse_json,
+          options));
+  }
+  testing::internal::GetCapturedStderr();
+#endif
+}
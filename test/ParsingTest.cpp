@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include "Options.h"
 #include "Parsing.h"
 
 TEST(parsing, json_parse_test_0) {
@@ -22,3 +23,66 @@ TEST(parsing, json_parse_test_0) {
   ASSERT_EQ(Command("s", Strings{"a+", "b", "g"}, std::nullopt),
       expected_commands.value()[2]);
 }
+
+TEST(parsing, json_stream_test_0) {
+  constexpr auto script = R"({
+  "d": { "address": 1 },
+  "a": { "address": 1, "arguments": ["my_text", "my_other_text"] },
+  "s": { "arguments": ["a+", "b", "g"] },
+  "=": { },
+  "n": { "arguments": [] }
+})";
+  ASSERT_EQ(parse_json(script).value(), parse_json_stream(script).value());
+}
+
+TEST(parsing, json_stream_test_1) {
+  // a repeated name means what it means to parse_json, one command of it
+  constexpr auto script = R"({
+  "s": { "arguments": ["one", "1"] },
+  "p": { },
+  "s": { "arguments": ["two", "2"] },
+  "p": { "address": 2 }
+})";
+  ASSERT_EQ(2, parse_json(script).value().size());
+  ASSERT_EQ(parse_json(script).value(), parse_json_stream(script).value());
+}
+
+TEST(parsing, json_stream_test_2) {
+  // the same errors parse_json gives
+  for (auto script : {R"({ "p": 1 })", R"({ "p": { "address": "1" } })",
+      R"({ "p": { "label": ["x"] } })"}) {
+    ASSERT_EQ(parse_json(script).error(), parse_json_stream(script).error())
+      << script;
+  }
+  ASSERT_FALSE(parse_json_stream(R"({ "s": { "arguments": ["a", 1] } })"));
+  ASSERT_FALSE(parse_json_stream(R"({ "s": { "arguments": ["a" )"));
+  ASSERT_FALSE(parse_json_stream(R"(["s"])"));
+}
+
+// parse_arguments of sim option in.txt w.json
+auto parse_option(const std::string& option)
+  -> tl::expected<Arguments, std::string> {
+  auto argv = std::vector<std::string>{"sim", option, "in.txt", "w.json"};
+  auto pointers = std::vector<char*>();
+  for (auto& argument : argv) {
+    pointers.push_back(argument.data());
+  }
+  return parse_arguments(static_cast<int>(pointers.size()), pointers.data());
+}
+
+TEST(parsing, arguments_test_0) {
+  // stoull read "-1" as 2^64 - 1, counts are unsigned so a sign is an error
+  for (auto option : {"--threads=-1", "--exec-jobs=-1", "--trace-sample=-1",
+      "--trace-threshold=-1", "--output-buffer=-1", "--threads= 1",
+      "--threads=", "--threads=1x", "--trace-threshold=18446744073709551615"}) {
+    ASSERT_FALSE(parse_option(option)) << option;
+  }
+  ASSERT_EQ(3, parse_option("--threads=3")->options.threads);
+}
+
+TEST(parsing, arguments_test_1) {
+  // every output file gets a buffer this size up front
+  ASSERT_EQ(max_output_buffer_bytes, parse_option("--output-buffer=1073741824")
+      ->options.output_buffer_bytes);
+  ASSERT_FALSE(parse_option("--output-buffer=1073741825"));
+}
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#endif
+
+#include <nlohmann/json.hpp>
+
+#include "Context.h"
+#include "Profiler.h"
+#include "TestHelpers.h"
+
+constexpr static auto profiler_script = R"({
+  "s": { "arguments": ["line #[12]", "row"] },
+  "t": { "arguments": ["end"] },
+  "a": { "arguments": ["not a row"] },
+  ":": { "arguments": ["end"] },
+  "i": { "address": 3, "arguments": ["third"] }
+})";
+
+TEST(profiler, run_profiled_test_0) {
+  auto profile = Profile();
+  auto result = run_profiled(loaded_context(numbered_lines, profiler_script),
+      profile).result;
+
+  ASSERT_EQ(execute(numbered_lines, profiler_script), result);
+  ASSERT_EQ(5, profile.size());
+  // s on every line, t jumps over a on the two lines s changed
+  ASSERT_EQ(4, profile[0].invocations);
+  ASSERT_EQ(2, profile[1].jumps_taken);
+  ASSERT_EQ(2, profile[2].invocations);
+  // the label is jumped past, so only the lines falling through reach it
+  ASSERT_EQ(2, profile[3].invocations);
+  ASSERT_EQ(4, profile[4].invocations);
+  ASSERT_EQ(1, profile[4].address_hits);
+  ASSERT_EQ(3, profile[4].address_skips);
+  // "This is row" is 4 bytes shorter than "This is line #1"
+  ASSERT_EQ(profile[0].bytes_in - 8, profile[0].bytes_out);
+  ASSERT_EQ(profile[2].bytes_in + 2 * std::string("\nnot a row").size(),
+      profile[2].bytes_out);
+}
+
+TEST(profiler, run_profiled_test_1) {
+  // a branch to a missing label jumps to the end of the script, d ends it too
+  // but isn't a jump
+  auto profile = Profile();
+  run_profiled(loaded_context(numbered_lines, R"({
+  "b": { "address": 1, "arguments": ["missing"] },
+  "d": { "address": 2 },
+  "p": { }
+})"), profile);
+
+  ASSERT_EQ(1, profile[0].jumps_taken);
+  ASSERT_EQ(0, profile[1].jumps_taken);
+  ASSERT_EQ(2, profile[2].invocations);
+}
+
+TEST(profiler, profile_json_test_0) {
+  auto profile = Profile();
+  auto context = run_profiled(loaded_context(numbered_lines, profiler_script),
+      profile);
+  auto json = nlohmann::json::parse(profile_json(*context.commands, profile));
+
+  ASSERT_EQ(5, json["commands"].size());
+  ASSERT_EQ("t", json["commands"][1]["name"]);
+  ASSERT_EQ(1, json["commands"][1]["index"]);
+  ASSERT_EQ(2, json["commands"][1]["jumps_taken"]);
+  // in Opcode order: append, insert, substitute, branch_true, verify_label
+  ASSERT_EQ(5, json["opcodes"].size());
+  ASSERT_EQ("substitute", json["opcodes"][2]["opcode"]);
+  ASSERT_EQ(1, json["opcodes"][2]["commands"]);
+  ASSERT_EQ(4, json["opcodes"][2]["invocations"]);
+}
+
+TEST(profiler, profile_by_opcode_test_0) {
+  auto profile = Profile(4);
+  profile[0] = {3, 3, 0, 1000, 30, 20, 0, {1, 2, 3, 4}};
+  profile[1] = {2, 1, 1, 500, 10, 10, 0, {}};
+  profile[2] = {3, 3, 0, 2000, 20, 40, 0, {10, 20, 30, 40}};
+  profile[3] = {1, 1, 0, 100, 5, 5, 1, {}};
+  auto commands = Commands{
+    Command("s", std::nullopt, std::nullopt),
+    Command("p", std::nullopt, std::nullopt),
+    Command("substitute", std::nullopt, std::nullopt),
+    Command("not_a_builtin", std::nullopt, std::nullopt),
+  };
+
+  auto opcodes = profile_by_opcode(commands, profile);
+  ASSERT_EQ(3, opcodes.size());
+  ASSERT_EQ(Opcode::print_operations, opcodes[0].opcode);
+  ASSERT_EQ(Opcode::substitute, opcodes[1].opcode);
+  ASSERT_EQ(2, opcodes[1].commands);
+  ASSERT_EQ(6, opcodes[1].counts.invocations);
+  ASSERT_EQ(3000, opcodes[1].counts.nanoseconds);
+  ASSERT_EQ(60, opcodes[1].counts.bytes_out);
+  ASSERT_EQ(44, opcodes[1].counts.hardware[3]);
+  ASSERT_EQ(Opcode::custom, opcodes[2].opcode);
+  ASSERT_EQ(1, opcodes[2].counts.jumps_taken);
+
+  // the opcode table comes after the command table, slowest first
+  auto report = profile_report(commands, profile);
+  auto table = report.find("opcode");
+  ASSERT_NE(std::string::npos, table);
+  ASSERT_LT(report.find("substitute", table), report.find("print", table));
+  ASSERT_LT(report.find("print", table), report.find("custom", table));
+}
+
+TEST(profiler, profile_report_test_0) {
+  auto profile = Profile(2);
+  profile[0].nanoseconds = 1000;
+  profile[1].nanoseconds = 3000;
+  auto commands = Commands{
+    Command("p", std::nullopt, std::nullopt),
+    Command("=", std::nullopt, std::nullopt),
+  };
+
+  // slowest first
+  auto report = profile_report(commands, profile);
+  ASSERT_LT(report.find("75.0%"), report.find("25.0%"));
+  ASSERT_NE(std::string::npos, report.find("1  ="));
+}
+
+TEST(profiler, hardware_counts_test_0) {
+  auto profile = Profile(2);
+  auto commands = Commands{
+    Command("p", std::nullopt, std::nullopt),
+    Command("=", std::nullopt, std::nullopt),
+  };
+  ASSERT_EQ(std::string::npos, profile_report(commands, profile).find("ipc"));
+  ASSERT_FALSE(nlohmann::json::parse(profile_json(commands, profile))
+      ["commands"][0].contains("cycles"));
+
+  profile[1].hardware = {2000, 5000, 3, 7};
+  auto report = profile_report(commands, profile);
+  ASSERT_NE(std::string::npos, report.find("ipc"));
+  ASSERT_NE(std::string::npos, report.find("2.50"));
+  auto json = nlohmann::json::parse(profile_json(commands, profile));
+  ASSERT_EQ(0, json["commands"][0]["cycles"]);
+  ASSERT_EQ(5000, json["commands"][1]["instructions"]);
+  ASSERT_EQ(7, json["commands"][1]["cache_misses"]);
+  ASSERT_EQ(5000, json["opcodes"][1]["instructions"]);
+}
+
+TEST(profiler, hardware_counts_test_1) {
+  // counted or not (containers usually can't open the counters), the run is
+  // the same and the profile is written
+  auto options = Options();
+  options.profile = ProfileOutput::json;
+  options.profile_file = "profiler_hardware_counts_test_1.json";
+  options.profile_counters = true;
+  ASSERT_EQ(execute(numbered_lines, profiler_script),
+      execute(numbered_lines, profiler_script, std::nullopt, parse_json,
+        options));
+  auto json = nlohmann::json::parse(
+      file_to_string(options.profile_file).value());
+  ASSERT_EQ(5, json["commands"].size());
+  ASSERT_EQ(4, json["commands"][0]["invocations"]);
+}
+
+#if defined(__linux__)
+// Software events can be opened where the hardware ones can't, so they stand
+// in for them to check what's read gets attributed to the commands
+constexpr static auto task_clock = PerfEvent{PERF_TYPE_SOFTWARE,
+  PERF_COUNT_SW_TASK_CLOCK};
+constexpr static auto software_events = PerfEvents{task_clock, task_clock,
+  task_clock, task_clock};
+
+TEST(profiler, hardware_counts_test_2) {
+  auto counters = PerfCounters::open(software_events);
+  if (!counters) {
+    // seccomp or perf_event_paranoid 3 refuse even software events
+    GTEST_SKIP() << counters.error();
+  }
+
+  auto first = (*counters)->read();
+  auto second = (*counters)->read();
+  for (size_t event = 0; event < hardware_event_count; event++) {
+    ASSERT_GT(first[event], 0);
+    ASSERT_GE(second[event], first[event]);
+  }
+
+  auto profile = Profile();
+  run_instrumented(loaded_context(numbered_lines, profiler_script), &profile,
+      nullptr, nullptr, 0, nullptr, counters->get());
+  ASSERT_TRUE(has_hardware_counts(profile));
+  ASSERT_GT(profile[0].hardware[size_t(HardwareEvent::cycles)], 0);
+  ASSERT_GT(profile[0].hardware[size_t(HardwareEvent::cache_misses)], 0);
+}
+#endif
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <csignal>
+
+#include "Context.h"
+#include "Progress.h"
+
+TEST(progress, line_test_0) {
+  ASSERT_EQ("sim: 2000 lines, 1.0 MB in 2.0s, 1000 lines/s, 0.50 MB/s, "
+      "25.0% read, eta 6s\n", progress_line(2000, 1000000, 4000000,
+        std::chrono::seconds(2)));
+}
+
+TEST(progress, finish_test_0) {
+  // an interval of 0 only reports on SIGUSR1, so the file holds the totals
+  // finish reports
+  auto input = std::string();
+  for (int i = 0; i < 100; i++) {
+    input += "This is line #" + std::to_string(i) + nl;
+  }
+  auto script = R"({ "s": { "arguments": ["line", "row"] } })";
+  for (auto threads : {1, 4}) {
+    auto options = Options();
+    options.threads = threads;
+    options.parallel_min_bytes = 0;
+    options.progress = true;
+    options.progress_interval = std::chrono::milliseconds(0);
+    options.progress_file = "progress_finish_test_0.txt";
+    ASSERT_EQ(execute(input, script),
+        execute(input, script, std::nullopt, parse_json, options));
+    auto status = file_to_string(options.progress_file).value();
+    ASSERT_TRUE(status.starts_with("sim: 100 lines, ")) << status;
+    ASSERT_NE(std::string::npos, status.find("100.0% read")) << status;
+  }
+}
+
+namespace {
+  volatile std::sig_atomic_t host_signals = 0;
+
+  extern "C" auto host_handler(int) -> void {
+    host_signals = host_signals + 1;
+  }
+}
+
+TEST(progress, signal_test_0) {
+  // a host process's own SIGUSR1 handler is back once the run is done
+  auto previous = std::signal(SIGUSR1, host_handler);
+  auto options = Options();
+  options.progress = true;
+  options.progress_interval = std::chrono::milliseconds(0);
+  options.progress_file = "progress_signal_test_0.txt";
+  execute("one\ntwo\n", R"({ "p": { } })", std::nullopt, parse_json,
+      options);
+  host_signals = 0;
+  std::raise(SIGUSR1);
+  ASSERT_EQ(1, host_signals);
+  std::signal(SIGUSR1, previous);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "Context.h"
+
+// Each script is run over 1x, 4x and 16x the input and a line is fitted
+// through log(time) against log(size). Linear work gives an exponent around 1,
+// the quadratic paths these guard against gave 2, so anything above
+// max_exponent means one of them is back.
+constexpr static auto base_lines = size_t(4000);
+constexpr static auto max_exponent = 1.4;
+// best of, to keep a busy machine from failing the test
+constexpr static auto repetitions = 3;
+
+auto scaling_input(size_t lines) -> std::string {
+  auto result = std::string();
+  for (size_t i = 0; i < lines; i++) {
+    result += "line " + std::to_string(i) + " of the scaling input, abcabc"
+      + nl;
+  }
+  return result;
+}
+
+// The same text as one line, for commands whose cost grows with the pattern
+// space rather than with the number of lines
+auto scaling_line(size_t lines) -> std::string {
+  auto result = scaling_input(lines);
+  std::replace(result.begin(), result.end(), '\n', ' ');
+  return result + nl;
+}
+
+auto seconds_to_execute(const std::string& input, const std::string& script,
+    const Options& options) -> double {
+  auto best = std::numeric_limits<double>::max();
+  for (int i = 0; i < repetitions; i++) {
+    auto start = std::chrono::steady_clock::now();
+    auto result = execute(input, script, std::nullopt, parse_json, options);
+    auto elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, elapsed);
+  }
+  return best;
+}
+
+// Least squares slope of log(seconds) over log(lines)
+auto growth_exponent(const std::string& script,
+    const Options& options = Options(),
+    std::string (*make_input)(size_t) = scaling_input) -> double {
+  auto xs = std::vector<double>();
+  auto ys = std::vector<double>();
+  for (auto scale : {1, 4, 16}) {
+    auto lines = base_lines * scale;
+    xs.push_back(std::log(static_cast<double>(lines)));
+    ys.push_back(std::log(seconds_to_execute(make_input(lines), script,
+            options)));
+  }
+  auto mean_x = (xs[0] + xs[1] + xs[2]) / 3;
+  auto mean_y = (ys[0] + ys[1] + ys[2]) / 3;
+  auto covariance = 0.0;
+  auto variance = 0.0;
+  for (size_t i = 0; i < xs.size(); i++) {
+    covariance += (xs[i] - mean_x) * (ys[i] - mean_y);
+    variance += (xs[i] - mean_x) * (xs[i] - mean_x);
+  }
+  return covariance / variance;
+}
+
+TEST(scaling, input_consumption_test_0) {
+  // every line used to copy the rest of the input
+  ASSERT_LT(growth_exponent(R"({ ":": { "arguments": ["nothing"] } })"),
+      max_exponent);
+}
+
+TEST(scaling, input_consumption_test_1) {
+  // n and N read ahead through the same input
+  ASSERT_LT(growth_exponent(R"({ "n": { }, "N": { } })"), max_exponent);
+}
+
+TEST(scaling, input_consumption_test_2) {
+  auto options = Options();
+  options.batch = true;
+  ASSERT_LT(growth_exponent(R"({ "y": { "arguments": ["line", "LINE"] } })",
+        options), max_exponent);
+}
+
+TEST(scaling, nl_add_to_static_test_0) {
+  // the hold space grows with the input, appending to it has to stay cheap
+  ASSERT_LT(growth_exponent(R"({ "H": { } })"), max_exponent);
+}
+
+TEST(scaling, delete_restart_test_0) {
+  ASSERT_LT(growth_exponent(R"({ "N": { }, "D": { } })"), max_exponent);
+}
+
+TEST(scaling, translate_test_0) {
+  // every replacement used to search again from the start of the line
+  ASSERT_LT(growth_exponent(R"({ "y": { "arguments": ["abc", "xyz"] } })",
+        Options(), scaling_line), max_exponent);
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include "Context.h"
+#include "ScriptCache.h"
+#include "Version.h"
+#include "TestHelpers.h"
+
+constexpr static auto cache_script = R"({
+  "s": { "arguments": ["line", "row"] },
+  "w": { "address": 2, "arguments": ["script_cache_test.txt"] },
+  "a": { "arguments": ["row"] },
+  ":": { "arguments": ["end"] },
+  "=": { }
+})";
+
+auto fresh_cache_directory(const std::string& name) -> std::string {
+  std::filesystem::remove_all(name);
+  return name;
+}
+
+TEST(script_cache, round_trip_test_0) {
+  auto directory = fresh_cache_directory("script_cache_round_trip_test_0");
+  auto commands = parse_json(cache_script).value();
+  auto program = compile_commands(commands).value();
+  auto key = script_cache_key(cache_script, false);
+  ASSERT_FALSE(load_cached_script(directory, key, cache_script));
+  ASSERT_TRUE(store_cached_script(directory, key, cache_script, commands,
+        program));
+
+  auto cached = load_cached_script(directory, key, cache_script);
+  ASSERT_TRUE(cached);
+  ASSERT_EQ(commands, cached->commands);
+  ASSERT_EQ(program.size(), cached->program.size());
+  for (size_t i = 0; i < program.size(); i++) {
+    ASSERT_EQ(program[i].opcode, cached->program[i].opcode);
+    ASSERT_EQ(program[i].function, cached->program[i].function);
+    ASSERT_EQ(program[i].slot, cached->program[i].slot);
+  }
+}
+
+TEST(script_cache, key_test_0) {
+  ASSERT_EQ(script_cache_key(cache_script, false),
+      script_cache_key(cache_script, false));
+  ASSERT_NE(script_cache_key(cache_script, false),
+      script_cache_key(cache_script, true));
+  ASSERT_NE(script_cache_key(cache_script, false),
+      script_cache_key(std::string(cache_script) + " ", false));
+}
+
+TEST(script_cache, truncated_test_0) {
+  auto directory = fresh_cache_directory("script_cache_truncated_test_0");
+  auto commands = parse_json(cache_script).value();
+  auto key = script_cache_key(cache_script, false);
+  ASSERT_TRUE(store_cached_script(directory, key, cache_script, commands,
+        compile_commands(commands).value()));
+  auto path = std::filesystem::path(directory) / key;
+  auto size = std::filesystem::file_size(path);
+  for (auto cut : {size - 1, size / 2, uintmax_t(3)}) {
+    std::filesystem::resize_file(path, cut);
+    ASSERT_FALSE(load_cached_script(directory, key, cache_script)) << cut;
+  }
+}
+
+TEST(script_cache, execute_test_0) {
+  auto options = Options();
+  options.script_cache_dir = fresh_cache_directory("script_cache_execute_test_0");
+  auto expected = execute(numbered_lines, cache_script);
+
+  // the first run stores it, the second never parses the json
+  ASSERT_EQ(expected, execute(numbered_lines, cache_script, std::nullopt,
+        parse_json, options));
+  auto key = script_cache_key(cache_script, false);
+  ASSERT_TRUE(std::filesystem::exists(
+        std::filesystem::path(options.script_cache_dir) / key));
+  auto unparsable = [](const std::string&) -> ResultCommands {
+    return tl::make_unexpected("parsed");
+  };
+  std::filesystem::remove("script_cache_test.txt");
+  ASSERT_EQ(expected, execute(numbered_lines, cache_script, std::nullopt,
+        unparsable, options));
+  ASSERT_EQ(std::string("This is row #2\n"),
+      file_to_string("script_cache_test.txt").value());
+}
+
+TEST(script_cache, front_end_test_0) {
+  // both front ends read a script the same, so they can share one entry
+  constexpr auto script = R"({
+  "s": { "arguments": ["a", "b"] },
+  "p": { },
+  "s": { "arguments": ["b", "c"] }
+})";
+  auto options = Options();
+  options.script_cache_dir = fresh_cache_directory("script_cache_front_end_test_0");
+  auto expected = execute("a\n", script);
+  ASSERT_EQ(expected, execute("a\n", script, std::nullopt, parse_json_stream,
+        options));
+  ASSERT_EQ(expected, execute("a\n", script, std::nullopt, parse_json,
+        options));
+}
+
+TEST(script_cache, damaged_test_0) {
+  // a string count far past the end of the entry is missing, not allocated
+  auto directory = fresh_cache_directory("script_cache_damaged_test_0");
+  auto commands = parse_json(cache_script).value();
+  auto key = script_cache_key(cache_script, false);
+  ASSERT_TRUE(store_cached_script(directory, key, cache_script, commands,
+        compile_commands(commands).value()));
+  auto path = std::filesystem::path(directory) / key;
+  auto entry = file_to_string(path.string()).value();
+  // magic, format, the version string and the digest come first
+  auto string_count = 3 * sizeof(uint32_t) + std::string(sim_version).size()
+    + sizeof(uint64_t);
+  auto huge = uint32_t(0x7fffffff);
+  entry.replace(string_count, sizeof(huge),
+      std::string(reinterpret_cast<const char*>(&huge), sizeof(huge)));
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << entry;
+  ASSERT_FALSE(load_cached_script(directory, key, cache_script));
+}
+
+TEST(script_cache, collision_test_0) {
+  // an entry stored for another script under the same key is never used
+  auto directory = fresh_cache_directory("script_cache_collision_test_0");
+  auto commands = parse_json(cache_script).value();
+  auto key = script_cache_key(cache_script, false);
+  ASSERT_TRUE(store_cached_script(directory, key, cache_script, commands,
+        compile_commands(commands).value()));
+  auto other = std::string(cache_script);
+  other.back() = ' ';
+  ASSERT_FALSE(load_cached_script(directory, key, other));
+}
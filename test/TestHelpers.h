@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "Context.h"
+
+// The input the tests run their scripts over unless they need something
+// particular
+constexpr static auto numbered_lines = R"(This is line #1
+This is line #2
+This is line #3
+This is line #4
+)";
+
+// A Context over input with the json script parsed, compiled and its files
+// opened, ready for run_instrumented and friends
+inline auto loaded_context(const std::string& input, const std::string& script)
+  -> Context {
+  auto context = Context(std::make_pair(std::nullopt, input));
+  context.commands = std::make_shared<const Commands>(
+      parse_json(script).value());
+  context.program = std::make_shared<const Program>(
+      compile_commands(*context.commands).value());
+  context.handles = open_handles(*context.commands, *context.program,
+      Options()).value();
+  return context;
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "Context.h"
+#include "TestHelpers.h"
+
+constexpr static auto trace_script = R"({
+  "s": { "arguments": ["line", "row"] },
+  "p": { }
+})";
+
+auto traced_events(const Options& options) -> nlohmann::json {
+  auto result = execute(numbered_lines, trace_script, std::nullopt, parse_json,
+      options);
+  EXPECT_EQ(execute(numbered_lines, trace_script), result);
+  return nlohmann::json::parse(file_to_string(options.trace_file).value())
+    ["traceEvents"];
+}
+
+auto events_named(const nlohmann::json& events, const std::string& name)
+  -> std::vector<nlohmann::json> {
+  auto result = std::vector<nlohmann::json>();
+  for (const auto& event : events) {
+    if (event["name"] == name) {
+      result.push_back(event);
+    }
+  }
+  return result;
+}
+
+TEST(trace, sample_test_0) {
+  auto options = Options();
+  options.trace_file = "trace_sample_test_0.json";
+  options.trace_sample_every = 2;
+  options.trace_threshold = std::chrono::hours(1);
+  auto events = traced_events(options);
+
+  auto cycles = events_named(events, "cycle");
+  ASSERT_EQ(2, cycles.size());
+  ASSERT_EQ(1, cycles[0]["args"]["cycle"]);
+  ASSERT_EQ(3, cycles[1]["args"]["cycle"]);
+  // only the kept cycles' commands are written
+  ASSERT_EQ(2, events_named(events, "s").size());
+  ASSERT_EQ(1, events_named(events, "load script").size());
+  ASSERT_EQ(1, events_named(events, "flush output files").size());
+}
+
+TEST(trace, threshold_test_0) {
+  // every cycle takes at least 0ns, so none are sampled away
+  auto options = Options();
+  options.trace_file = "trace_threshold_test_0.json";
+  options.trace_sample_every = 1000;
+  options.trace_threshold = std::chrono::nanoseconds(0);
+  auto events = traced_events(options);
+
+  ASSERT_EQ(4, events_named(events, "cycle").size());
+  auto commands = events_named(events, "p");
+  ASSERT_EQ(4, commands.size());
+  ASSERT_EQ(1, commands[0]["args"]["index"]);
+  ASSERT_EQ("command", commands[0]["cat"]);
+}